@@ -36,10 +36,10 @@ public:
         return result;
     }
 
-    void Erase(int document_id){
-        Bucket &x = vec_bucket_.at(static_cast<uint64_t>(document_id) % vec_bucket_.size());
+    void Erase(const Key& key){
+        Bucket &x = vec_bucket_.at(static_cast<uint64_t>(key) % vec_bucket_.size());
         std::lock_guard guard(x.mtx);
-        x.mp.erase(document_id);
+        x.mp.erase(key);
     }
 
 private:
@@ -0,0 +1,139 @@
+#include "corpus_loader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace {
+
+struct CorpusChunk {
+    std::vector<NewDocument> documents;
+    std::exception_ptr error;
+};
+
+[[noreturn]] void ThrowBadRecord(size_t offset) {
+    throw std::invalid_argument("Неверная строка корпуса в позиции " + std::to_string(offset));
+}
+
+int ParseNumber(std::string_view text, size_t offset) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+        ThrowBadRecord(offset);
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text, size_t offset) {
+    static const std::string_view NAMES[] = {"ACTUAL", "IRRELEVANT", "BANNED", "REMOVED"};
+    for (size_t status = 0; status < std::size(NAMES); ++status) {
+        if (text == NAMES[status]) {
+            return static_cast<DocumentStatus>(status);
+        }
+    }
+    const int status = ParseNumber(text, offset);
+    if (status < 0 || status >= static_cast<int>(std::size(NAMES))) {
+        ThrowBadRecord(offset);
+    }
+    return static_cast<DocumentStatus>(status);
+}
+
+// строка без перевода строки: id, статус, рейтинги и текст через табуляцию
+NewDocument ParseRecord(std::string_view line, size_t offset) {
+    const size_t id_end = line.find('\t');
+    const size_t status_end = id_end == line.npos ? line.npos : line.find('\t', id_end + 1);
+    const size_t ratings_end = status_end == line.npos ? line.npos : line.find('\t', status_end + 1);
+    if (ratings_end == line.npos) {
+        ThrowBadRecord(offset);
+    }
+    NewDocument document;
+    document.id = ParseNumber(line.substr(0, id_end), offset);
+    document.status = ParseStatus(line.substr(id_end + 1, status_end - id_end - 1), offset);
+    std::string_view ratings = line.substr(status_end + 1, ratings_end - status_end - 1);
+    while (!ratings.empty()) {
+        const size_t rating_end = std::min(ratings.find(' '), ratings.size());
+        if (rating_end > 0) {
+            document.ratings.push_back(ParseNumber(ratings.substr(0, rating_end), offset));
+        }
+        ratings.remove_prefix(std::min(rating_end + 1, ratings.size()));
+    }
+    document.text = line.substr(ratings_end + 1);
+    return document;
+}
+
+void ParseChunk(const char* data, size_t first, size_t last, CorpusChunk& chunk) {
+    try {
+        size_t position = first;
+        while (position < last) {
+            const void* const line_break = std::memchr(data + position, '\n', last - position);
+            const size_t line_end = line_break == nullptr ? last : static_cast<const char*>(line_break) - data;
+            std::string_view line(data + position, line_end - position);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                chunk.documents.push_back(ParseRecord(line, position));
+            }
+            position = line_end + 1;
+        }
+    } catch (...) {
+        chunk.error = std::current_exception();
+    }
+}
+
+}  // namespace
+
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t chunk_bytes) {
+    const MappedFile file(path);
+    const char* const data = file.GetData();
+    const size_t size = file.GetSize();
+    chunk_bytes = std::max<size_t>(chunk_bytes, 1);
+    // граница куска сдвигается вперед на начало ближайшей строки
+    const auto align = [data, size](size_t offset) -> size_t {
+        if (offset >= size) {
+            return size;
+        }
+        const void* const line_break = std::memchr(data + offset - 1, '\n', size - offset + 1);
+        return line_break == nullptr ? size : static_cast<const char*>(line_break) - data + 1;
+    };
+
+    // окно из нескольких кусков на поток разбирается параллельно и уходит в индекс одним пакетом,
+    // поэтому память под документы не зависит от размера файла
+    const size_t window_chunks = std::max(1u, std::thread::hardware_concurrency()) * 4;
+    size_t document_count = 0;
+    size_t window_begin = 0;
+    while (window_begin < size) {
+        std::vector<size_t> bounds = {window_begin};
+        while (bounds.size() <= window_chunks && bounds.back() < size) {
+            bounds.push_back(align(bounds.back() + chunk_bytes));
+        }
+        const size_t window_end = bounds.back();
+        // следующее окно подкачивается с диска, пока текущее разбирается и индексируется
+        file.Prefetch(window_end, window_end - window_begin);
+
+        std::vector<CorpusChunk> chunks(bounds.size() - 1);
+        std::vector<size_t> indexes(chunks.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+            ParseChunk(data, bounds[index], bounds[index + 1], chunks[index]);
+        });
+        std::vector<NewDocument> documents;
+        for (CorpusChunk& chunk : chunks) {
+            if (chunk.error) std::rethrow_exception(chunk.error);
+            documents.insert(documents.end(), std::make_move_iterator(chunk.documents.begin()), std::make_move_iterator(chunk.documents.end()));
+        }
+        search_server.AddDocuments(documents);
+        document_count += documents.size();
+        window_begin = window_end;
+    }
+    return document_count;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+#include "search_server.h"
+
+// столько байт файла корпуса разбирает одна задача
+const size_t CORPUS_CHUNK_BYTES = 1 << 20;
+
+// Загружает корпус из файла: строка на документ, поля через табуляцию -
+// id, статус, рейтинги через пробел (могут отсутствовать) и текст до конца строки.
+// Статус - число или имя (ACTUAL, IRRELEVANT, BANNED, REMOVED). Пустые строки пропускаются.
+// Файл отображается в память, куски по chunk_bytes разбираются параллельно без копирования
+// текстов, и документы пакетами передаются в AddDocuments. Возвращает число добавленных документов.
+// Бросает invalid_argument для неверной строки; пакеты, добавленные до нее, остаются в сервере
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t chunk_bytes = CORPUS_CHUNK_BYTES);
@@ -0,0 +1,14 @@
+#pragma once
+#include <limits>
+#include <utility>
+#include <vector>
+#include "document.h"
+
+// Декларативный фильтр документов. Пустой список статусов или диапазонов id
+// означает отсутствие ограничения; диапазоны рейтинга и id включают границы.
+struct DocumentFilter {
+    std::vector<DocumentStatus> statuses;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    std::vector<std::pair<int, int>> id_ranges;
+};
@@ -0,0 +1,209 @@
+#include "document_table.h"
+#include <algorithm>
+
+DocumentTable::Slot DocumentTable::Add(int document_id, int rating, DocumentStatus status) {
+    const Slot slot = static_cast<Slot>(ids_.size());
+    ids_.push_back(document_id);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    alive_.push_back(true);
+    if (slot % 64 == 0) {
+        for (auto& words : status_words_) {
+            words.push_back(0);
+        }
+    }
+    status_words_[static_cast<size_t>(status)].Mutable(slot / 64) |= uint64_t{1} << (slot % 64);
+    slots_.Insert(document_id, slot);
+    ++document_count_;
+    RebuildSlotsIfNeeded();
+    // id обычно растут: тогда актуальный список просто продолжается, если его не делит копия таблицы
+    std::vector<int>& sorted_ids = *sorted_ids_.ids;
+    if (sorted_ids_.is_valid.load(std::memory_order_relaxed) && sorted_ids_.ids.use_count() == 1
+        && (sorted_ids.empty() || sorted_ids.back() < document_id)) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        sorted_ids.push_back(document_id);
+    } else {
+        sorted_ids_.is_valid.store(false, std::memory_order_relaxed);
+    }
+    return slot;
+}
+
+void DocumentTable::Remove(Slot slot) {
+    const int document_id = ids_[slot];
+    alive_.Mutable(slot) = false;
+    status_words_[static_cast<size_t>(statuses_[slot])].Mutable(slot / 64) &= ~(uint64_t{1} << (slot % 64));
+    slots_.Erase(document_id);
+    --document_count_;
+    RebuildSlotsIfNeeded();
+    sorted_ids_.is_valid.store(false, std::memory_order_relaxed);
+}
+
+DocumentTable::Slot DocumentTable::FindSlot(int document_id) const {
+    const Slot* slot = slots_.Find(document_id, [this](int, Slot slot) { return alive_[slot] != 0; });
+    return slot == nullptr ? NO_SLOT : *slot;
+}
+
+void DocumentTable::RebuildSlotsIfNeeded() {
+    if (slots_.NeedsRebuild()) {
+        slots_.Rebuild([this](int, Slot slot) { return alive_[slot] != 0; });
+    }
+}
+
+size_t DocumentTable::GetSlotCount() const {
+    return ids_.size();
+}
+
+size_t DocumentTable::GetDocumentCount() const {
+    return document_count_;
+}
+
+const std::vector<int>& DocumentTable::GetSortedIds() const {
+    if (!sorted_ids_.is_valid.load(std::memory_order_acquire)) {
+        std::lock_guard lock(sorted_ids_.mutex);
+        if (!sorted_ids_.is_valid.load(std::memory_order_relaxed)) {
+            // прежний список может читать копия таблицы: он заменяется новым
+            auto ids = std::make_shared<std::vector<int>>();
+            ids->reserve(document_count_);
+            for (Slot slot = 0; slot < ids_.size(); ++slot) {
+                if (alive_[slot]) {
+                    ids->push_back(ids_[slot]);
+                }
+            }
+            std::sort(ids->begin(), ids->end());
+            sorted_ids_.ids = std::move(ids);
+            sorted_ids_.is_valid.store(true, std::memory_order_release);
+        }
+    }
+    return *sorted_ids_.ids;
+}
+
+SlotBitmap DocumentTable::Select(const DocumentFilter& filter, const SearchBudget* budget) const {
+    SlotBitmap candidates(ids_.size());
+    // бюджет сверяется после каждого куска слов статуса
+    bool is_stopped = false;
+    const auto or_status = [&candidates, &is_stopped, budget](size_t first, const uint64_t* data, size_t count) {
+        if (!is_stopped) {
+            candidates.OrWords(first, data, count);
+            is_stopped = budget != nullptr && budget->IsExhausted();
+        }
+    };
+    if (filter.statuses.empty()) {
+        for (const auto& words : status_words_) {
+            words.ForEachChunk(or_status);
+        }
+    } else {
+        for (const DocumentStatus status : filter.statuses) {
+            status_words_[static_cast<size_t>(status)].ForEachChunk(or_status);
+        }
+    }
+
+    const bool check_rating = filter.min_rating != std::numeric_limits<int>::min()
+                              || filter.max_rating != std::numeric_limits<int>::max();
+    if (is_stopped || (!check_rating && filter.id_ranges.empty())) {
+        return candidates;
+    }
+    size_t unchecked_slots = 0;
+    candidates.ForEachWhile([this, &filter, &candidates, &unchecked_slots, budget](Slot slot) {
+        if (!MatchesColumns(slot, filter)) {
+            candidates.Reset(slot);
+        }
+        if (budget != nullptr && ++unchecked_slots == BUDGET_CHECK_INTERVAL) {
+            unchecked_slots = 0;
+            return !budget->IsExhausted();
+        }
+        return true;
+    });
+    return candidates;
+}
+
+bool DocumentTable::Matches(Slot slot, const DocumentFilter& filter) const {
+    return alive_[slot]
+           && (filter.statuses.empty() || std::find(filter.statuses.begin(), filter.statuses.end(), statuses_[slot]) != filter.statuses.end())
+           && MatchesColumns(slot, filter);
+}
+
+bool DocumentTable::MatchesColumns(Slot slot, const DocumentFilter& filter) const {
+    if (ratings_[slot] < filter.min_rating || ratings_[slot] > filter.max_rating) {
+        return false;
+    }
+    const int id = ids_[slot];
+    return filter.id_ranges.empty()
+           || std::any_of(filter.id_ranges.begin(), filter.id_ranges.end(),
+                          [id](const auto& range) { return range.first <= id && id <= range.second; });
+}
+
+void DocumentTable::Save(IndexFileWriter& writer) const {
+    std::vector<int32_t> statuses;
+    statuses.reserve(statuses_.size());
+    for (const DocumentStatus status : statuses_.ToVector()) {
+        statuses.push_back(static_cast<int32_t>(status));
+    }
+    writer.WriteArray(ids_.ToVector());
+    writer.WriteArray(ratings_.ToVector());
+    writer.WriteArray(statuses);
+    writer.WriteArray(alive_.ToVector());
+}
+
+DocumentTable DocumentTable::Load(IndexSectionReader& reader) {
+    const auto ids = reader.ReadArray<int>();
+    const auto ratings = reader.ReadArray<int>();
+    const auto statuses = reader.ReadArray<int32_t>();
+    const auto alive = reader.ReadArray<uint8_t>();
+    if (ratings.size != ids.size || statuses.size != ids.size || alive.size != ids.size) {
+        throw std::runtime_error("Поврежден файл индекса: несогласованная таблица документов");
+    }
+    DocumentTable table;
+    table.ids_.resize(ids.size);
+    table.ratings_.resize(ids.size);
+    table.statuses_.resize(ids.size);
+    table.alive_.resize(ids.size);
+    for (auto& words : table.status_words_) {
+        words.resize((ids.size + 63) / 64);
+    }
+    SharedHashIndex<int, Slot>::Map slots;
+    for (Slot slot = 0; slot < ids.size; ++slot) {
+        if (statuses[slot] < 0 || static_cast<size_t>(statuses[slot]) >= STATUS_COUNT) {
+            throw std::runtime_error("Поврежден файл индекса: несогласованная таблица документов");
+        }
+        table.ids_.Mutable(slot) = ids[slot];
+        table.ratings_.Mutable(slot) = ratings[slot];
+        table.statuses_.Mutable(slot) = static_cast<DocumentStatus>(statuses[slot]);
+        table.alive_.Mutable(slot) = alive[slot];
+        if (alive[slot]) {
+            table.status_words_[statuses[slot]].Mutable(slot / 64) |= uint64_t{1} << (slot % 64);
+            slots.emplace(ids[slot], slot);
+        }
+    }
+    table.document_count_ = slots.size();
+    table.slots_.Reset(std::move(slots));
+    table.sorted_ids_.is_valid.store(false, std::memory_order_relaxed);
+    return table;
+}
+
+DocumentTable::SortedIds::SortedIds(const SortedIds& other) {
+    *this = other;
+}
+
+DocumentTable::SortedIds& DocumentTable::SortedIds::operator=(const SortedIds& other) {
+    if (this != &other) {
+        // копируемую таблицу могут в это же время читать другие потоки
+        std::lock_guard lock(other.mutex);
+        ids = other.ids;
+        is_valid.store(other.is_valid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+DocumentTable::SortedIds::SortedIds(SortedIds&& other) noexcept {
+    *this = std::move(other);
+}
+
+DocumentTable::SortedIds& DocumentTable::SortedIds::operator=(SortedIds&& other) noexcept {
+    if (this != &other) {
+        ids.swap(other.ids);
+        is_valid.store(other.is_valid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // прежний список этой таблицы достается пустой: он пересоберется при чтении
+        other.is_valid.store(false, std::memory_order_relaxed);
+    }
+    return *this;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "document.h"
+#include "document_filter.h"
+#include "index_file.h"
+#include "search_budget.h"
+#include "shared_chunk_vector.h"
+#include "shared_hash_index.h"
+#include "slot_bitmap.h"
+
+// Плотная таблица документов. Каждому документу выделяется слот - позиция в столбцах
+// с рейтингом, статусом и признаком жизни. Слоты выдаются по возрастанию и не переиспользуются,
+// поэтому списки вхождений, упорядоченные по слотам, пополняются только в конец.
+// Копии таблицы делят столбцы и поиск по id и копируют только измененные после копирования куски.
+class DocumentTable {
+public:
+    using Slot = uint32_t;
+    static constexpr Slot NO_SLOT = std::numeric_limits<Slot>::max();
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    Slot Add(int document_id, int rating, DocumentStatus status);
+    void Remove(Slot slot);
+    Slot FindSlot(int document_id) const;
+
+    int GetId(Slot slot) const {
+        return ids_[slot];
+    }
+    int GetRating(Slot slot) const {
+        return ratings_[slot];
+    }
+    DocumentStatus GetStatus(Slot slot) const {
+        return statuses_[slot];
+    }
+    bool IsAlive(Slot slot) const {
+        return alive_[slot];
+    }
+
+    // число выданных слотов, включая слоты удаленных документов
+    size_t GetSlotCount() const;
+    size_t GetDocumentCount() const;
+    // id живых документов по возрастанию. Удаление и добавление не по возрастанию id
+    // лишь помечают список устаревшим, и он пересобирается один раз при следующем чтении;
+    // ссылка действительна до изменения таблицы
+    const std::vector<int>& GetSortedIds() const;
+    // слоты живых документов, проходящих фильтр: статусы берутся из готовых битовых карт,
+    // рейтинг и id проверяются по столбцам только для оставшихся слотов. Исчерпав budget,
+    // отбор останавливается, и множество остается неполным
+    SlotBitmap Select(const DocumentFilter& filter, const SearchBudget* budget = nullptr) const;
+    // та же проверка для одного слота: для немногих документов дешевле битовых карт
+    bool Matches(Slot slot, const DocumentFilter& filter) const;
+
+    // сохраняются столбцы, а битовые карты статусов и поиск по id восстанавливаются по ним
+    void Save(IndexFileWriter& writer) const;
+    static DocumentTable Load(IndexSectionReader& reader);
+
+private:
+    SharedChunkVector<int> ids_;
+    SharedChunkVector<int> ratings_;
+    SharedChunkVector<DocumentStatus> statuses_;
+    SharedChunkVector<uint8_t> alive_;
+    // слова битовых карт живых документов с данным статусом, индекс - значение DocumentStatus
+    std::vector<SharedChunkVector<uint64_t>> status_words_ = std::vector<SharedChunkVector<uint64_t>>(STATUS_COUNT);
+    // запись основы действительна, пока жив ее слот
+    SharedHashIndex<int, Slot> slots_;
+    size_t document_count_ = 0;
+
+    // список пересобирается в const-методе, возможно, из нескольких читающих потоков сразу;
+    // копии таблицы делят готовый список, а общий список не дописывается, а устаревает
+    struct SortedIds {
+        std::shared_ptr<std::vector<int>> ids = std::make_shared<std::vector<int>>();
+        std::atomic<bool> is_valid = true;
+        mutable std::mutex mutex;
+
+        SortedIds() = default;
+        SortedIds(const SortedIds& other);
+        SortedIds& operator=(const SortedIds& other);
+        SortedIds(SortedIds&& other) noexcept;
+        SortedIds& operator=(SortedIds&& other) noexcept;
+    };
+    mutable SortedIds sorted_ids_;
+
+    bool MatchesColumns(Slot slot, const DocumentFilter& filter) const;
+    void RebuildSlotsIfNeeded();
+};
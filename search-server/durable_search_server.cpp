@@ -0,0 +1,189 @@
+#include "durable_search_server.h"
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <stdexcept>
+
+#include "index_file.h"
+
+namespace {
+
+const std::string SNAPSHOT_PREFIX = "snapshot-";
+const std::string SNAPSHOT_SUFFIX = ".idx";
+const std::string LOG_PREFIX = "wal-";
+const std::string LOG_SUFFIX = ".log";
+// сколько подряд идущих добавлений из журнала применяется одним AddDocuments
+const size_t REPLAY_BATCH_DOCUMENTS = 16384;
+
+// номера дополняются нулями, чтобы имена файлов сортировались как номера
+std::string FormatSequence(uint64_t sequence) {
+    std::string digits = std::to_string(sequence);
+    return std::string(20 - digits.size(), '0') + digits;
+}
+
+// номера файлов каталога вида <prefix><номер><suffix> по возрастанию
+std::vector<uint64_t> ListSequences(const std::string& directory, const std::string& prefix, const std::string& suffix) {
+    std::vector<uint64_t> sequences;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() != prefix.size() + 20 + suffix.size() || name.compare(0, prefix.size(), prefix) != 0
+            || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        const std::string digits = name.substr(prefix.size(), 20);
+        if (std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            sequences.push_back(std::stoull(digits));
+        }
+    }
+    std::sort(sequences.begin(), sequences.end());
+    return sequences;
+}
+
+}  // namespace
+
+DurableSearchServer::DurableSearchServer(const std::string& directory, const std::string& stop_words, const WriteAheadLogOptions& options)
+    : directory_(directory), options_(options) {
+    std::filesystem::create_directories(directory_);
+    Recover(stop_words);
+}
+
+void DurableSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    server_->AddDocument(document_id, document, status, ratings);
+    log_->AppendAdd(document_id, document, status, ratings);
+}
+
+void DurableSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    server_->AddDocuments(documents);
+    for (const NewDocument& document : documents) {
+        log_->AppendAdd(document.id, document.text, document.status, document.ratings);
+    }
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    server_->RemoveDocument(document_id);
+    log_->AppendRemove(document_id);
+}
+
+void DurableSearchServer::Sync() {
+    log_->Sync();
+}
+
+void DurableSearchServer::Checkpoint() {
+    log_->Sync();
+    const uint64_t sequence = log_->GetLastSequence();
+    // с последнего снимка ничего не изменилось: перезапись оставила бы без единственного целого снимка
+    if (sequence == snapshot_sequence_ && std::filesystem::exists(GetSnapshotPath(sequence))) {
+        return;
+    }
+    // Save сбрасывает на диск и файл снимка, и каталог с его именем
+    server_->Save(GetSnapshotPath(sequence));
+    log_.reset();
+    log_ = std::make_unique<WriteAheadLog>(GetLogPath(sequence + 1), sequence + 1, 0, options_);
+    SyncPath(directory_);
+    // новый снимок может оказаться нечитаемым, поэтому остаются и предыдущий целый снимок,
+    // и журналы с записями после него; удаляются более старые и не загрузившиеся снимки
+    const uint64_t previous_sequence = snapshot_sequence_;
+    for (const uint64_t old_sequence : ListSequences(directory_, SNAPSHOT_PREFIX, SNAPSHOT_SUFFIX)) {
+        if (old_sequence != previous_sequence && old_sequence != sequence) {
+            std::filesystem::remove(GetSnapshotPath(old_sequence));
+        }
+    }
+    const std::vector<uint64_t> logs = ListSequences(directory_, LOG_PREFIX, LOG_SUFFIX);
+    for (size_t i = 0; i + 1 < logs.size(); ++i) {
+        // журнал заканчивается перед первой записью следующего
+        if (logs[i + 1] <= previous_sequence + 1) {
+            std::filesystem::remove(GetLogPath(logs[i]));
+        }
+    }
+    snapshot_sequence_ = sequence;
+}
+
+const SearchServer& DurableSearchServer::GetServer() const {
+    return *server_;
+}
+
+uint64_t DurableSearchServer::GetLastSequence() const {
+    return log_->GetLastSequence();
+}
+
+size_t DurableSearchServer::GetReplayedRecordCount() const {
+    return replayed_records_;
+}
+
+std::string DurableSearchServer::GetSnapshotPath(uint64_t sequence) const {
+    return (std::filesystem::path(directory_) / (SNAPSHOT_PREFIX + FormatSequence(sequence) + SNAPSHOT_SUFFIX)).string();
+}
+
+std::string DurableSearchServer::GetLogPath(uint64_t first_sequence) const {
+    return (std::filesystem::path(directory_) / (LOG_PREFIX + FormatSequence(first_sequence) + LOG_SUFFIX)).string();
+}
+
+void DurableSearchServer::Recover(const std::string& stop_words) {
+    // снимок, недописанный или испорченный после записи, не проходит проверку
+    // контрольных сумм всех секций, и берется предыдущий
+    uint64_t snapshot_sequence = 0;
+    const std::vector<uint64_t> snapshots = ListSequences(directory_, SNAPSHOT_PREFIX, SNAPSHOT_SUFFIX);
+    LoadOptions load_options;
+    load_options.verify_postings = true;
+    for (auto sequence = snapshots.rbegin(); sequence != snapshots.rend() && !server_; ++sequence) {
+        try {
+            server_ = std::make_unique<SearchServer>(SearchServer::Load(GetSnapshotPath(*sequence), load_options));
+            snapshot_sequence = *sequence;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    if (!server_) {
+        server_ = std::make_unique<SearchServer>(stop_words);
+    }
+    snapshot_sequence_ = snapshot_sequence;
+
+    // подряд идущие добавления применяются пакетом, как при обычной массовой загрузке;
+    // тексты копируются, потому что пакет переживает отображение своего журнала
+    std::deque<std::string> batch_texts;
+    std::vector<NewDocument> batch;
+    const auto apply_batch = [this, &batch_texts, &batch]() {
+        if (!batch.empty()) {
+            server_->AddDocuments(batch);
+            batch.clear();
+            batch_texts.clear();
+        }
+    };
+    const auto apply_record = [this, &batch_texts, &batch, &apply_batch](const LogRecord& record) {
+        if (record.type == LogRecordType::ADD_DOCUMENT) {
+            batch_texts.emplace_back(record.text);
+            batch.push_back({record.document_id, batch_texts.back(), record.status, record.ratings});
+            if (batch.size() >= REPLAY_BATCH_DOCUMENTS) {
+                apply_batch();
+            }
+        } else {
+            apply_batch();
+            server_->RemoveDocument(record.document_id);
+        }
+        ++replayed_records_;
+    };
+
+    // журналы идут подряд по номерам записей; применяются только записи после снимка
+    const std::vector<uint64_t> logs = ListSequences(directory_, LOG_PREFIX, LOG_SUFFIX);
+    uint64_t last_sequence = 0;
+    WriteAheadLog::ReplayResult result;
+    for (size_t i = 0; i < logs.size(); ++i) {
+        if (i == 0 ? logs[i] > snapshot_sequence + 1 : logs[i] != last_sequence + 1) {
+            throw std::runtime_error("В журнале " + directory_ + " не хватает записей");
+        }
+        result = WriteAheadLog::Replay(GetLogPath(logs[i]), logs[i], snapshot_sequence, apply_record);
+        // недописанной может быть только последняя запись последнего журнала
+        if (result.is_torn && i + 1 < logs.size()) {
+            throw std::runtime_error("Поврежден журнал " + GetLogPath(logs[i]));
+        }
+        last_sequence = result.last_sequence;
+    }
+    apply_batch();
+
+    if (!logs.empty() && last_sequence >= snapshot_sequence) {
+        log_ = std::make_unique<WriteAheadLog>(GetLogPath(logs.back()), last_sequence + 1, result.valid_size, options_);
+    } else {
+        log_ = std::make_unique<WriteAheadLog>(GetLogPath(snapshot_sequence + 1), snapshot_sequence + 1, 0, options_);
+        SyncPath(directory_);
+    }
+}
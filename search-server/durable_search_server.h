@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+// Поисковый сервер, переживающий сбой. Успешные AddDocument и RemoveDocument пишутся
+// в журнал упреждающей записи. Checkpoint сохраняет снимок индекса и начинает новый журнал.
+// Каталог хранит снимки snapshot-<номер>.idx и журналы wal-<номер первой записи>.log.
+// При запуске загружается последний целый снимок, и применяются только записи журнала
+// с номерами после него.
+class DurableSearchServer {
+public:
+    // восстанавливает сервер из каталога; без снимков и журналов создает пустой сервер
+    // со стоп-словами stop_words
+    DurableSearchServer(const std::string& directory, const std::string& stop_words, const WriteAheadLogOptions& options = {});
+
+    // операция применяется к индексу, и только успешная попадает в журнал;
+    // надежной она становится после сброса своего пакета журнала или Sync,
+    // но не позже WriteAheadLogOptions::sync_max_delay
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    void Sync();
+    // сохраняет снимок и начинает новый журнал. Предыдущий целый снимок и журналы после него
+    // остаются до следующего Checkpoint, а более старые снимки и журналы удаляются.
+    // Без новых записей после последнего снимка ничего не делает
+    void Checkpoint();
+
+    const SearchServer& GetServer() const;
+    // номер последней операции в журнале
+    uint64_t GetLastSequence() const;
+    // сколько записей журнала применено при восстановлении
+    size_t GetReplayedRecordCount() const;
+
+private:
+    std::string directory_;
+    WriteAheadLogOptions options_;
+    std::unique_ptr<SearchServer> server_;
+    std::unique_ptr<WriteAheadLog> log_;
+    size_t replayed_records_ = 0;
+    // последний снимок, который загрузился или был записан этим сервером; 0 - снимка нет
+    uint64_t snapshot_sequence_ = 0;
+
+    std::string GetSnapshotPath(uint64_t sequence) const;
+    std::string GetLogPath(uint64_t first_sequence) const;
+    void Recover(const std::string& stop_words);
+};
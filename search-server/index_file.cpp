@@ -0,0 +1,217 @@
+#include "index_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace {
+
+const char INDEX_FILE_MAGIC[8] = {'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+// записывается как есть; файл с другим порядком байт читается как чужой
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+// секции начинаются с границы страницы, чтобы подкачивать их независимо
+const uint64_t SECTION_ALIGNMENT = 4096;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t table_offset;
+    uint64_t section_count;
+    uint64_t table_checksum;
+    uint64_t file_size;
+};
+
+struct SectionEntry {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+}  // namespace
+
+uint64_t ComputeIndexChecksum(const char* data, size_t size, uint64_t checksum) {
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        checksum = (checksum ^ word) * 1099511628211ull;
+    }
+    return checksum;
+}
+
+void SyncPath(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось сбросить на диск " + path);
+    }
+    int result;
+    do {
+        result = fsync(fd);
+    } while (result != 0 && errno == EINTR);
+    close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Не удалось сбросить на диск " + path);
+    }
+}
+
+IndexFileWriter::IndexFileWriter(const std::string& path)
+    : path_(path), temp_path_(path + ".tmp"), out_(temp_path_, std::ios::binary | std::ios::trunc) {
+    // заголовок пишется в Finish, когда известна таблица секций
+    const FileHeader header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset_ = sizeof(header);
+    Check();
+}
+
+IndexFileWriter::~IndexFileWriter() {
+    if (!finished_) {
+        out_.close();
+        std::remove(temp_path_.c_str());
+    }
+}
+
+void IndexFileWriter::BeginSection(IndexSectionKind kind) {
+    PadTo(SECTION_ALIGNMENT);
+    sections_.push_back({kind, offset_, 0, INDEX_CHECKSUM_SEED});
+}
+
+void IndexFileWriter::EndSection() {
+    sections_.back().size = offset_ - sections_.back().offset;
+}
+
+void IndexFileWriter::Finish() {
+    std::vector<SectionEntry> table;
+    table.reserve(sections_.size());
+    for (const Section& section : sections_) {
+        table.push_back({static_cast<uint32_t>(section.kind), 0, section.offset, section.size, section.checksum});
+    }
+    FileHeader header{};
+    std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version = INDEX_FILE_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.table_offset = offset_;
+    header.section_count = table.size();
+    header.table_checksum = ComputeIndexChecksum(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionEntry), INDEX_CHECKSUM_SEED);
+    header.file_size = offset_ + table.size() * sizeof(SectionEntry);
+    out_.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionEntry));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    Check();
+    // данные файла должны попасть на диск раньше, чем имя: иначе после сбоя
+    // под именем path может оказаться пустой или недописанный файл
+    SyncPath(temp_path_);
+    // читатели старого файла видят либо его, либо новый целиком
+    if (std::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("Не удалось записать файл индекса " + path_);
+    }
+    finished_ = true;
+    const std::filesystem::path directory = std::filesystem::path(path_).parent_path();
+    SyncPath(directory.empty() ? "." : directory.string());
+}
+
+void IndexFileWriter::WriteBytes(const void* data, size_t size) {
+    const char* const bytes = static_cast<const char*>(data);
+    const size_t whole_size = size / 8 * 8;
+    char tail[8] = {};
+    if (whole_size < size) {
+        std::memcpy(tail, bytes + whole_size, size - whole_size);
+    }
+    out_.write(bytes, whole_size);
+    if (whole_size < size) {
+        out_.write(tail, sizeof(tail));
+    }
+    if (!sections_.empty()) {
+        uint64_t& checksum = sections_.back().checksum;
+        checksum = ComputeIndexChecksum(bytes, whole_size, checksum);
+        if (whole_size < size) {
+            checksum = ComputeIndexChecksum(tail, sizeof(tail), checksum);
+        }
+    }
+    offset_ += whole_size + (whole_size < size ? sizeof(tail) : 0);
+    Check();
+}
+
+void IndexFileWriter::PadTo(uint64_t alignment) {
+    const uint64_t padding = (alignment - offset_ % alignment) % alignment;
+    const std::vector<char> zeros(padding, 0);
+    out_.write(zeros.data(), zeros.size());
+    offset_ += padding;
+    Check();
+}
+
+void IndexFileWriter::Check() {
+    if (!out_) {
+        throw std::runtime_error("Не удалось записать файл индекса " + path_);
+    }
+}
+
+const char* IndexSectionReader::ReadBytes(size_t size) {
+    const size_t padded_size = (size + 7) / 8 * 8;
+    if (padded_size > size_ - position_) {
+        throw std::runtime_error("Поврежден файл индекса");
+    }
+    const char* const bytes = data_ + position_;
+    position_ += padded_size;
+    return bytes;
+}
+
+IndexFileReader::IndexFileReader(const std::string& path)
+    : file_(std::make_shared<const MappedFile>(path)) {
+    FileHeader header;
+    if (file_->GetSize() < sizeof(header)) {
+        throw std::runtime_error("Файл " + path + " не является файлом индекса");
+    }
+    std::memcpy(&header, file_->GetData(), sizeof(header));
+    if (std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) != 0 || header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Файл " + path + " не является файлом индекса");
+    }
+    if (header.version != INDEX_FILE_VERSION) {
+        throw std::runtime_error("Неподдерживаемая версия файла индекса " + path);
+    }
+    if (header.file_size != file_->GetSize() || header.table_offset > header.file_size
+        || header.section_count != (header.file_size - header.table_offset) / sizeof(SectionEntry)) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    const char* const table = file_->GetData() + header.table_offset;
+    if (ComputeIndexChecksum(table, header.section_count * sizeof(SectionEntry), INDEX_CHECKSUM_SEED) != header.table_checksum) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    for (size_t i = 0; i < header.section_count; ++i) {
+        SectionEntry entry;
+        std::memcpy(&entry, table + i * sizeof(SectionEntry), sizeof(entry));
+        if (entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > header.table_offset || entry.size > header.table_offset - entry.offset) {
+            throw std::runtime_error("Поврежден файл индекса " + path);
+        }
+        sections_.push_back({static_cast<IndexSectionKind>(entry.kind), entry.offset, entry.size, entry.checksum});
+    }
+}
+
+size_t IndexFileReader::GetSectionCount() const {
+    return sections_.size();
+}
+
+IndexSectionKind IndexFileReader::GetSectionKind(size_t index) const {
+    return sections_[index].kind;
+}
+
+IndexSectionReader IndexFileReader::OpenSection(size_t index, bool verify) const {
+    const Section& section = sections_[index];
+    const char* const data = file_->GetData() + section.offset;
+    if (verify && ComputeIndexChecksum(data, section.size, INDEX_CHECKSUM_SEED) != section.checksum) {
+        throw std::runtime_error("Поврежден файл индекса: неверная контрольная сумма секции");
+    }
+    return IndexSectionReader(data, section.size, section.offset);
+}
+
+void IndexFileReader::PrefetchSection(size_t index) const {
+    file_->Prefetch(sections_[index].offset, sections_[index].size);
+}
+
+const std::shared_ptr<const MappedFile>& IndexFileReader::GetFile() const {
+    return file_;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Двоичный файл индекса. За заголовком идут секции, каждая с границы страницы, а в конце -
+// таблица секций. Заголовок хранит версию формата, порядок байт и контрольную сумму таблицы,
+// таблица - смещение, размер и контрольную сумму каждой секции. Внутри секции значения
+// и массивы выровнены на 8 байт, поэтому массивы читаются прямо из отображенного файла.
+const uint32_t INDEX_FILE_VERSION = 1;
+
+enum class IndexSectionKind : uint32_t {
+    SERVER = 1,
+    SEGMENT = 2,
+};
+
+// массив внутри отображенного файла
+template <typename T>
+struct MappedArray {
+    const T* data = nullptr;
+    size_t size = 0;
+
+    const T* begin() const {
+        return data;
+    }
+    const T* end() const {
+        return data + size;
+    }
+    const T& operator[](size_t index) const {
+        return data[index];
+    }
+};
+
+const uint64_t INDEX_CHECKSUM_SEED = 14695981039346656037ull;
+
+// FNV-1a по 8-байтовым словам; size кратен 8
+uint64_t ComputeIndexChecksum(const char* data, size_t size, uint64_t checksum);
+
+// fsync файла или каталога: для каталога это делает надежными созданные и переименованные файлы
+void SyncPath(const std::string& path);
+
+class IndexFileWriter {
+public:
+    // пишет во временный файл рядом с path; Finish сбрасывает его на диск и заменяет им path
+    explicit IndexFileWriter(const std::string& path);
+    IndexFileWriter(const IndexFileWriter&) = delete;
+    IndexFileWriter& operator=(const IndexFileWriter&) = delete;
+    // незавершенный временный файл удаляется
+    ~IndexFileWriter();
+
+    void BeginSection(IndexSectionKind kind);
+    template <typename T>
+    void Write(T value);
+    template <typename T>
+    void WriteArray(const T* data, size_t size);
+    template <typename T>
+    void WriteArray(const std::vector<T>& values) {
+        WriteArray(values.data(), values.size());
+    }
+    void EndSection();
+    void Finish();
+
+private:
+    struct Section {
+        IndexSectionKind kind;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    std::vector<Section> sections_;
+    uint64_t offset_ = 0;
+    bool finished_ = false;
+
+    // дополняет данные нулями до кратной 8 длины
+    void WriteBytes(const void* data, size_t size);
+    void PadTo(uint64_t alignment);
+    void Check();
+};
+
+// последовательное чтение одной секции отображенного файла
+class IndexSectionReader {
+public:
+    IndexSectionReader(const char* data, size_t size, uint64_t offset)
+        : data_(data), size_(size), offset_(offset) {
+    }
+
+    template <typename T>
+    T Read();
+    template <typename T>
+    MappedArray<T> ReadArray();
+
+    // смещение секции от начала файла
+    uint64_t GetOffset() const {
+        return offset_;
+    }
+    uint64_t GetSize() const {
+        return size_;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    uint64_t offset_;
+    size_t position_ = 0;
+
+    // бросает runtime_error, если в секции не осталось size байт
+    const char* ReadBytes(size_t size);
+};
+
+class IndexFileReader {
+public:
+    // проверяет заголовок и таблицу секций; бросает runtime_error для чужого или поврежденного файла
+    explicit IndexFileReader(const std::string& path);
+
+    size_t GetSectionCount() const;
+    IndexSectionKind GetSectionKind(size_t index) const;
+    // verify сверяет контрольную сумму, а значит, читает секцию с диска целиком
+    IndexSectionReader OpenSection(size_t index, bool verify) const;
+    void PrefetchSection(size_t index) const;
+    // файл живет, пока на него ссылаются данные, читаемые из него без копирования
+    const std::shared_ptr<const MappedFile>& GetFile() const;
+
+private:
+    struct Section {
+        IndexSectionKind kind;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+    std::shared_ptr<const MappedFile> file_;
+    std::vector<Section> sections_;
+};
+
+template <typename T>
+void IndexFileWriter::Write(T value) {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= 8);
+    WriteBytes(&value, sizeof(T));
+}
+
+template <typename T>
+void IndexFileWriter::WriteArray(const T* data, size_t size) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+    Write<uint64_t>(size);
+    WriteBytes(data, size * sizeof(T));
+}
+
+template <typename T>
+T IndexSectionReader::Read() {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= 8);
+    T value;
+    std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+MappedArray<T> IndexSectionReader::ReadArray() {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+    const uint64_t size = Read<uint64_t>();
+    if (size > (size_ - position_) / sizeof(T)) {
+        throw std::runtime_error("Поврежден файл индекса");
+    }
+    return {reinterpret_cast<const T*>(ReadBytes(size * sizeof(T))), static_cast<size_t>(size)};
+}
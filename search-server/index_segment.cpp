@@ -0,0 +1,178 @@
+#include "index_segment.h"
+#include "stream_vbyte.h"
+
+IndexSegment::IndexSegment(Slot first_slot, Slot last_slot)
+    : first_slot_(first_slot), last_slot_(last_slot) {
+}
+
+void IndexSegment::BeginTerm(TermId term_id) {
+    term_ids_.push_back(term_id);
+    max_term_freqs_.push_back(0);
+}
+
+void IndexSegment::AddPosting(Slot slot, float term_freq) {
+    if ((slots_.size() - posting_offsets_.back()) % PostingSpan::BLOCK_SIZE == 0) {
+        block_max_term_freqs_.push_back(term_freq);
+    } else {
+        block_max_term_freqs_.mutable_back() = std::max(block_max_term_freqs_.back(), term_freq);
+    }
+    max_term_freqs_.mutable_back() = std::max(max_term_freqs_.back(), term_freq);
+    slots_.push_back(slot);
+    term_freqs_.push_back(term_freq);
+}
+
+void IndexSegment::EndTerm() {
+    if (slots_.size() == posting_offsets_.back()) {
+        term_ids_.pop_back();
+        max_term_freqs_.pop_back();
+        return;
+    }
+    posting_offsets_.push_back(slots_.size());
+    block_offsets_.push_back(block_max_term_freqs_.size());
+}
+
+PostingSpan IndexSegment::GetPostings(TermId term_id, std::pmr::memory_resource* resource) const {
+    const auto itr = std::lower_bound(term_ids_.begin(), term_ids_.end(), term_id);
+    if (itr == term_ids_.end() || *itr != term_id) {
+        return {};
+    }
+    const size_t index = itr - term_ids_.begin();
+    const size_t size = posting_offsets_[index + 1] - posting_offsets_[index];
+    if (!is_compressed_) {
+        return {slots_.data() + posting_offsets_[index], term_freqs_.data() + posting_offsets_[index],
+                block_max_term_freqs_.data() + block_offsets_[index], size, max_term_freqs_[index]};
+    }
+    auto* const slots = static_cast<Slot*>(resource->allocate(size * sizeof(Slot), alignof(Slot)));
+    auto* const codes = static_cast<uint32_t*>(resource->allocate(size * sizeof(uint32_t), alignof(uint32_t)));
+    auto* const term_freqs = static_cast<float*>(resource->allocate(size * sizeof(float), alignof(float)));
+    const uint8_t* const encoded = DecodeStreamVByte(encoded_postings_.data() + encoded_offsets_[index], size, true, slots);
+    DecodeStreamVByte(encoded, size, false, codes);
+    for (size_t i = 0; i < size; ++i) {
+        term_freqs[i] = term_freq_values_[codes[i]];
+    }
+    return {slots, term_freqs, block_max_term_freqs_.data() + block_offsets_[index], size, max_term_freqs_[index]};
+}
+
+void IndexSegment::Compress() {
+    if (is_compressed_) {
+        return;
+    }
+    term_freq_values_.assign(term_freqs_.begin(), term_freqs_.end());
+    std::sort(term_freq_values_.begin(), term_freq_values_.end());
+    term_freq_values_.erase(std::unique(term_freq_values_.begin(), term_freq_values_.end()), term_freq_values_.end());
+    encoded_offsets_.assign(1, 0);
+    encoded_postings_.clear();
+    std::vector<uint32_t> codes;
+    for (size_t index = 0; index < term_ids_.size(); ++index) {
+        const size_t begin = posting_offsets_[index];
+        const size_t end = posting_offsets_[index + 1];
+        codes.clear();
+        for (size_t i = begin; i < end; ++i) {
+            codes.push_back(std::lower_bound(term_freq_values_.begin(), term_freq_values_.end(), term_freqs_[i]) - term_freq_values_.begin());
+        }
+        EncodeStreamVByte(slots_.data() + begin, end - begin, true, encoded_postings_);
+        EncodeStreamVByte(codes.data(), codes.size(), false, encoded_postings_);
+        encoded_offsets_.push_back(encoded_postings_.size());
+    }
+    encoded_postings_.resize(encoded_postings_.size() + STREAM_VBYTE_PADDING, 0);
+    encoded_postings_.shrink_to_fit();
+    slots_ = {};
+    term_freqs_ = {};
+    is_compressed_ = true;
+}
+
+void IndexSegment::Decompress() {
+    if (!is_compressed_) {
+        return;
+    }
+    std::vector<Slot> slots;
+    std::vector<float> term_freqs;
+    DecodeAll(slots, term_freqs);
+    slots_ = SegmentArray<Slot>(std::move(slots));
+    term_freqs_ = SegmentArray<float>(std::move(term_freqs));
+    encoded_offsets_ = {};
+    encoded_postings_ = {};
+    term_freq_values_ = {};
+    is_compressed_ = false;
+}
+
+size_t IndexSegment::GetPostingBytes() const {
+    if (is_compressed_) {
+        return encoded_offsets_.size() * sizeof(uint64_t) + encoded_postings_.size() + term_freq_values_.size() * sizeof(float);
+    }
+    return slots_.size() * sizeof(Slot) + term_freqs_.size() * sizeof(float);
+}
+
+void IndexSegment::DecodeAll(std::vector<Slot>& slots, std::vector<float>& term_freqs) const {
+    slots.resize(GetPostingCount());
+    term_freqs.resize(GetPostingCount());
+    QueryArena arena;
+    for (size_t index = 0; index < term_ids_.size(); ++index) {
+        const QueryArena::Scope scope(arena);
+        const PostingSpan postings = GetPostings(term_ids_[index], scope.GetResource());
+        std::copy(postings.GetSlots(), postings.GetSlots() + postings.size(), slots.begin() + posting_offsets_[index]);
+        std::copy(postings.GetTermFreqs(), postings.GetTermFreqs() + postings.size(), term_freqs.begin() + posting_offsets_[index]);
+    }
+}
+
+void IndexSegment::Save(IndexFileWriter& writer) const {
+    writer.Write(first_slot_);
+    writer.Write(last_slot_);
+    writer.WriteArray(term_ids_.data(), term_ids_.size());
+    writer.WriteArray(posting_offsets_.data(), posting_offsets_.size());
+    writer.WriteArray(block_offsets_.data(), block_offsets_.size());
+    writer.WriteArray(max_term_freqs_.data(), max_term_freqs_.size());
+    if (is_compressed_) {
+        std::vector<Slot> slots;
+        std::vector<float> term_freqs;
+        DecodeAll(slots, term_freqs);
+        writer.WriteArray(slots.data(), slots.size());
+        writer.WriteArray(term_freqs.data(), term_freqs.size());
+    } else {
+        writer.WriteArray(slots_.data(), slots_.size());
+        writer.WriteArray(term_freqs_.data(), term_freqs_.size());
+    }
+    writer.WriteArray(block_max_term_freqs_.data(), block_max_term_freqs_.size());
+}
+
+IndexSegment IndexSegment::Load(IndexSectionReader& reader, std::shared_ptr<const MappedFile> file, size_t term_count) {
+    IndexSegment segment;
+    segment.first_slot_ = reader.Read<Slot>();
+    segment.last_slot_ = reader.Read<Slot>();
+    segment.term_ids_ = SegmentArray<TermId>(reader.ReadArray<TermId>());
+    segment.posting_offsets_ = SegmentArray<uint64_t>(reader.ReadArray<uint64_t>());
+    segment.block_offsets_ = SegmentArray<uint64_t>(reader.ReadArray<uint64_t>());
+    segment.max_term_freqs_ = SegmentArray<float>(reader.ReadArray<float>());
+    segment.slots_ = SegmentArray<Slot>(reader.ReadArray<Slot>());
+    segment.term_freqs_ = SegmentArray<float>(reader.ReadArray<float>());
+    segment.block_max_term_freqs_ = SegmentArray<float>(reader.ReadArray<float>());
+    segment.file_ = std::move(file);
+    const size_t segment_term_count = segment.term_ids_.size();
+    if (segment.first_slot_ > segment.last_slot_ || segment.posting_offsets_.size() != segment_term_count + 1
+        || segment.block_offsets_.size() != segment_term_count + 1 || segment.max_term_freqs_.size() != segment_term_count
+        || segment.term_freqs_.size() != segment.slots_.size() || segment.posting_offsets_[0] != 0
+        || segment.block_offsets_[0] != 0 || segment.posting_offsets_.back() != segment.slots_.size()
+        || segment.block_offsets_.back() != segment.block_max_term_freqs_.size()) {
+        throw std::runtime_error("Поврежден файл индекса: несогласованный сегмент");
+    }
+    // запросы доверяют этим инвариантам без проверок, поэтому они сверяются и без контрольной суммы
+    for (size_t index = 0; index < segment_term_count; ++index) {
+        const uint64_t begin = segment.posting_offsets_[index];
+        const uint64_t end = segment.posting_offsets_[index + 1];
+        if (segment.term_ids_[index] >= term_count || (index > 0 && segment.term_ids_[index - 1] >= segment.term_ids_[index])
+            || begin >= end || end > segment.slots_.size()
+            || segment.block_offsets_[index + 1] - segment.block_offsets_[index]
+                   != (end - begin + PostingSpan::BLOCK_SIZE - 1) / PostingSpan::BLOCK_SIZE) {
+            throw std::runtime_error("Поврежден файл индекса: несогласованный сегмент");
+        }
+        Slot previous = segment.first_slot_;
+        for (uint64_t i = begin; i < end; ++i) {
+            const Slot slot = segment.slots_[i];
+            if (slot < previous || slot >= segment.last_slot_ || (i > begin && slot == previous)) {
+                throw std::runtime_error("Поврежден файл индекса: несогласованный сегмент");
+            }
+            previous = slot;
+        }
+    }
+    return segment;
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "index_file.h"
+#include "posting_span.h"
+#include "query_arena.h"
+
+// Массив сегмента: собственный у собранного сегмента или окно в отображенный файл индекса
+// у загруженного. Загруженный массив только читается.
+template <typename T>
+class SegmentArray {
+public:
+    SegmentArray() = default;
+    explicit SegmentArray(std::vector<T> values)
+        : owned_(std::move(values)) {
+    }
+    explicit SegmentArray(MappedArray<T> values)
+        : mapped_(values), is_mapped_(true) {
+    }
+
+    const T* data() const {
+        return is_mapped_ ? mapped_.data : owned_.data();
+    }
+    size_t size() const {
+        return is_mapped_ ? mapped_.size : owned_.size();
+    }
+    const T* begin() const {
+        return data();
+    }
+    const T* end() const {
+        return data() + size();
+    }
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    void push_back(T value) {
+        owned_.push_back(value);
+    }
+    void pop_back() {
+        owned_.pop_back();
+    }
+    // только для собственного массива собираемого сегмента
+    T& mutable_back() {
+        return owned_.back();
+    }
+
+private:
+    std::vector<T> owned_;
+    MappedArray<T> mapped_;
+    bool is_mapped_ = false;
+};
+
+// Неизменяемый сегмент индекса: вхождения документов со слотами из [first_slot, last_slot),
+// сложенные по терминам в плоские массивы (CSR). Термины сегмента упорядочены по id,
+// список термина ищется двоичным поиском. Сегмент собирается последовательными вызовами
+// BeginTerm/AddPosting/EndTerm с возрастающими id терминов и слотами либо
+// отображается из файла индекса без копирования массивов.
+// Сжатый сегмент хранит слоты и TF каждого термина в формате StreamVByte: слоты - разностями
+// соседних, TF - номерами в таблице различных TF сегмента, так что сжатие без потерь.
+// Максимумы TF блоков и терминов хранятся как есть, и оценки MaxScore не меняются.
+class IndexSegment {
+public:
+    using TermId = uint32_t;
+    using Slot = uint32_t;
+
+    IndexSegment() = default;
+    IndexSegment(Slot first_slot, Slot last_slot);
+
+    void BeginTerm(TermId term_id);
+    void AddPosting(Slot slot, float term_freq);
+    // термин без вхождений в сегмент не попадает
+    void EndTerm();
+
+    // сливает соседние сегменты parts (по возрастанию слотов) в один, оставляя вхождения,
+    // для слотов которых keep(slot) истинен
+    template <typename Keep>
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& parts, Keep keep);
+
+    // список сжатого сегмента распаковывается в память resource и действителен, пока она не освобождена
+    PostingSpan GetPostings(TermId term_id, std::pmr::memory_resource* resource) const;
+
+    // переводит списки в сжатый вид и обратно
+    void Compress();
+    void Decompress();
+    bool IsCompressed() const {
+        return is_compressed_;
+    }
+
+    // сжатый сегмент записывается распакованным: формат файла от сжатия не зависит
+    void Save(IndexFileWriter& writer) const;
+    // массивы сегмента остаются в файле, и file живет, пока жив сегмент. Бросает runtime_error,
+    // если массивы не согласованы между собой: смещения не растут, id терминов не меньше term_count
+    // или не возрастают, слоты списка не возрастают или выходят за диапазон сегмента.
+    // Проверка читает смещения и слоты; TF сверяются только контрольной суммой
+    static IndexSegment Load(IndexSectionReader& reader, std::shared_ptr<const MappedFile> file, size_t term_count);
+
+    Slot GetFirstSlot() const {
+        return first_slot_;
+    }
+    Slot GetLastSlot() const {
+        return last_slot_;
+    }
+    size_t GetPostingCount() const {
+        return posting_offsets_.back();
+    }
+    // память, занятая слотами и TF вхождений
+    size_t GetPostingBytes() const;
+
+private:
+    Slot first_slot_ = 0;
+    Slot last_slot_ = 0;
+    SegmentArray<TermId> term_ids_;
+    // вхождения i-го термина занимают [posting_offsets_[i], posting_offsets_[i + 1]),
+    // максимумы его блоков - [block_offsets_[i], block_offsets_[i + 1])
+    SegmentArray<uint64_t> posting_offsets_{std::vector<uint64_t>{0}};
+    SegmentArray<uint64_t> block_offsets_{std::vector<uint64_t>{0}};
+    SegmentArray<float> max_term_freqs_;
+    SegmentArray<Slot> slots_;
+    SegmentArray<float> term_freqs_;
+    SegmentArray<float> block_max_term_freqs_;
+    std::shared_ptr<const MappedFile> file_;
+    // у сжатого сегмента slots_ и term_freqs_ пусты, а списки i-го термина занимают
+    // [encoded_offsets_[i], encoded_offsets_[i + 1]) в encoded_postings_
+    bool is_compressed_ = false;
+    std::vector<uint64_t> encoded_offsets_;
+    std::vector<uint8_t> encoded_postings_;
+    std::vector<float> term_freq_values_;
+
+    void DecodeAll(std::vector<Slot>& slots, std::vector<float>& term_freqs) const;
+};
+
+template <typename Keep>
+IndexSegment IndexSegment::Merge(const std::vector<const IndexSegment*>& parts, Keep keep) {
+    IndexSegment merged(parts.front()->first_slot_, parts.back()->last_slot_);
+    std::vector<TermId> term_ids;
+    for (const IndexSegment* part : parts) {
+        term_ids.insert(term_ids.end(), part->term_ids_.begin(), part->term_ids_.end());
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    // диапазоны слотов частей идут подряд, поэтому k-путевое слияние списков - их склейка по порядку
+    QueryArena arena;
+    for (const TermId term_id : term_ids) {
+        const QueryArena::Scope scope(arena);
+        merged.BeginTerm(term_id);
+        for (const IndexSegment* part : parts) {
+            const PostingSpan postings = part->GetPostings(term_id, scope.GetResource());
+            for (size_t i = 0; i < postings.size(); ++i) {
+                if (keep(postings.GetSlots()[i])) {
+                    merged.AddPosting(postings.GetSlots()[i], postings.GetTermFreqs()[i]);
+                }
+            }
+        }
+        merged.EndTerm();
+    }
+    return merged;
+}
@@ -0,0 +1,48 @@
+#include "joined_results.h"
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+
+JoinedResults::JoinedResults(std::vector<std::vector<Document>> results) {
+    offsets_.resize(results.size() + 1);
+    for (size_t i = 0; i < results.size(); ++i) {
+        offsets_[i + 1] = offsets_[i] + results[i].size();
+    }
+    documents_.resize(offsets_.back());
+    std::vector<size_t> query_indexes(results.size());
+    std::iota(query_indexes.begin(), query_indexes.end(), 0);
+    std::for_each(std::execution::par, query_indexes.begin(), query_indexes.end(), [this, &results](size_t query_index) {
+        std::move(results[query_index].begin(), results[query_index].end(), documents_.begin() + offsets_[query_index]);
+    });
+}
+
+JoinedResults::const_iterator JoinedResults::begin() const {
+    return documents_.begin();
+}
+
+JoinedResults::const_iterator JoinedResults::end() const {
+    return documents_.end();
+}
+
+size_t JoinedResults::size() const {
+    return documents_.size();
+}
+
+bool JoinedResults::empty() const {
+    return documents_.empty();
+}
+
+const Document& JoinedResults::operator[](size_t index) const {
+    return documents_[index];
+}
+
+size_t JoinedResults::GetQueryCount() const {
+    return offsets_.size() - 1;
+}
+
+IteratorRange<JoinedResults::const_iterator> JoinedResults::GetQueryResults(size_t query_index) const {
+    if (query_index >= GetQueryCount()) throw std::out_of_range("Номер запроса переходит за допустимый диапазон");
+    return IteratorRange(documents_.begin() + offsets_[query_index], documents_.begin() + offsets_[query_index + 1]);
+}
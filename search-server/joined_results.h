@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+// Выдача пакета запросов в одном непрерывном буфере: документы всех запросов идут подряд
+// в порядке запросов, а смещения отмечают начало выдачи каждого запроса.
+// Итераторы произвольного доступа, без узла в куче на каждый документ.
+class JoinedResults {
+public:
+    using const_iterator = std::vector<Document>::const_iterator;
+
+    JoinedResults() = default;
+    // склеивает выдачи запросов: смещения считаются по размерам, и выдачи
+    // переносятся в буфер параллельно, каждая на свое место
+    explicit JoinedResults(std::vector<std::vector<Document>> results);
+    // выдачи query_count запросов, каждая не длиннее max_query_results документов: fill(номер запроса, out)
+    // пишет выдачу прямо в общий буфер начиная с out и возвращает ее длину. Запросы заполняют
+    // свои участки буфера параллельно, затем участки сдвигаются вплотную по готовым смещениям
+    template <typename Fill>
+    static JoinedResults Collect(size_t query_count, size_t max_query_results, Fill fill);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    const Document& operator[](size_t index) const;
+
+    size_t GetQueryCount() const;
+    // выдача одного запроса; бросает out_of_range для неверного номера
+    IteratorRange<const_iterator> GetQueryResults(size_t query_index) const;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_ = {0};
+};
+
+template <typename Fill>
+JoinedResults JoinedResults::Collect(size_t query_count, size_t max_query_results, Fill fill) {
+    JoinedResults joined;
+    joined.documents_.resize(query_count * max_query_results);
+    // до сдвига offsets_[i + 1] хранит длину выдачи запроса i
+    joined.offsets_.resize(query_count + 1);
+    std::vector<size_t> query_indexes(query_count);
+    std::iota(query_indexes.begin(), query_indexes.end(), 0);
+    std::for_each(std::execution::par, query_indexes.begin(), query_indexes.end(), [&joined, &fill, max_query_results](size_t query_index) {
+        joined.offsets_[query_index + 1] = fill(query_index, joined.documents_.data() + query_index * max_query_results);
+    });
+    // выдача сдвигается только влево: ее смещение не больше начала ее участка
+    const auto documents = joined.documents_.begin();
+    for (size_t query_index = 0; query_index < query_count; ++query_index) {
+        const size_t count = joined.offsets_[query_index + 1];
+        const auto area = documents + query_index * max_query_results;
+        std::move(area, area + count, documents + joined.offsets_[query_index]);
+        joined.offsets_[query_index + 1] = joined.offsets_[query_index] + count;
+    }
+    joined.documents_.resize(joined.offsets_.back());
+    return joined;
+}
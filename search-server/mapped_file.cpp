@@ -0,0 +1,48 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось открыть файл " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Не удалось открыть файл " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+        void* const data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Не удалось отобразить в память файл " + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // отображение остается действительным и после закрытия дескриптора
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const {
+    if (data_ == nullptr || offset >= size_) {
+        return;
+    }
+    // madvise требует начала диапазона на границе страницы
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page_size * page_size;
+    const size_t end = std::min(offset + size, size_);
+    madvise(const_cast<char*>(data_) + begin, end - begin, MADV_WILLNEED);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Файл, отображенный в память только для чтения. Страницы подкачиваются с диска
+// при первом обращении.
+class MappedFile {
+public:
+    // бросает runtime_error, если файл не удалось открыть или отобразить
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* GetData() const {
+        return data_;
+    }
+    size_t GetSize() const {
+        return size_;
+    }
+
+    // просит ядро заранее подкачать страницы диапазона (madvise(MADV_WILLNEED))
+    void Prefetch(size_t offset, size_t size) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
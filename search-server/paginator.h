@@ -14,7 +14,7 @@ public:
         return page.second;
     }
     size_t size() const{
-        return distance(page.begin, page.end);
+        return std::distance(page.first, page.second);
     }
     IteratorRange(Iterator begin, Iterator end) : page{begin, end}{
     }
@@ -0,0 +1,84 @@
+#include "posting_list.h"
+#include <algorithm>
+#include <iterator>
+
+void PostingList::Add(uint32_t slot, double term_freq) {
+    max_term_freq_ = std::max(max_term_freq_, static_cast<float>(term_freq));
+    if (slots_.empty() || slots_.back() < slot) {
+        if (slots_.size() % BLOCK_SIZE == 0) {
+            block_max_term_freqs_.push_back(static_cast<float>(term_freq));
+        } else {
+            block_max_term_freqs_.back() = std::max(block_max_term_freqs_.back(), static_cast<float>(term_freq));
+        }
+        slots_.push_back(slot);
+        term_freqs_.push_back(static_cast<float>(term_freq));
+        return;
+    }
+    const auto itr = std::lower_bound(slots_.begin(), slots_.end(), slot);
+    const auto pos = std::distance(slots_.begin(), itr);
+    if (itr != slots_.end() && *itr == slot) {
+        term_freqs_[pos] = static_cast<float>(term_freq);
+        UpdateBlockMaxes(pos);
+        return;
+    }
+    slots_.insert(itr, slot);
+    term_freqs_.insert(term_freqs_.begin() + pos, static_cast<float>(term_freq));
+    UpdateBlockMaxes(pos);
+}
+
+bool PostingList::Remove(uint32_t slot) {
+    const auto itr = std::lower_bound(slots_.begin(), slots_.end(), slot);
+    if (itr == slots_.end() || *itr != slot) {
+        return false;
+    }
+    const auto pos = std::distance(slots_.begin(), itr);
+    term_freqs_.erase(term_freqs_.begin() + pos);
+    slots_.erase(itr);
+    UpdateBlockMaxes(pos);
+    return true;
+}
+
+bool PostingList::Contains(uint32_t slot) const {
+    return std::binary_search(slots_.begin(), slots_.end(), slot);
+}
+
+void PostingList::Clear() {
+    slots_.clear();
+    term_freqs_.clear();
+    block_max_term_freqs_.clear();
+    max_term_freq_ = 0;
+}
+
+size_t PostingList::Seek(size_t position, uint32_t slot) const {
+    return GetSpan().Seek(position, slot);
+}
+
+size_t PostingList::size() const {
+    return slots_.size();
+}
+
+bool PostingList::empty() const {
+    return slots_.empty();
+}
+
+const std::vector<uint32_t>& PostingList::GetSlots() const {
+    return slots_;
+}
+
+const std::vector<float>& PostingList::GetTermFreqs() const {
+    return term_freqs_;
+}
+
+float PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+void PostingList::UpdateBlockMaxes(size_t position) {
+    // вставка и удаление сдвигают все последующие вхождения, поэтому меняются и все следующие блоки
+    block_max_term_freqs_.resize((slots_.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    for (size_t block = position / BLOCK_SIZE; block < block_max_term_freqs_.size(); ++block) {
+        const auto first = term_freqs_.begin() + block * BLOCK_SIZE;
+        const auto last = term_freqs_.begin() + std::min((block + 1) * BLOCK_SIZE, term_freqs_.size());
+        block_max_term_freqs_[block] = *std::max_element(first, last);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "posting_span.h"
+
+// Список вхождений термина: слоты документов (см. DocumentTable) и TF хранятся в двух
+// параллельных массивах, упорядоченных по возрастанию слота. Для каждого блока из BLOCK_SIZE
+// вхождений хранится максимальный TF, чтобы при поиске пропускать блоки целиком.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = PostingSpan::BLOCK_SIZE;
+
+    // слоты выдаются по возрастанию, поэтому вставка в конец - основной случай
+    void Add(uint32_t slot, double term_freq);
+    bool Remove(uint32_t slot);
+    // удаляет за один проход все вхождения, для слотов которых predicate(slot) истинен,
+    // и уточняет максимумы TF; возвращает число удаленных вхождений
+    template <typename Predicate>
+    size_t RemoveIf(Predicate predicate);
+    bool Contains(uint32_t slot) const;
+    void Clear();
+    // первая позиция не раньше position, слот в которой не меньше slot
+    size_t Seek(size_t position, uint32_t slot) const;
+
+    size_t size() const;
+    bool empty() const;
+
+    const std::vector<uint32_t>& GetSlots() const;
+    const std::vector<float>& GetTermFreqs() const;
+    // верхняя граница TF в списке; после удалений может быть завышена, но не занижена
+    float GetMaxTermFreq() const;
+
+    // точный максимум TF в блоке, содержащем позицию position
+    float GetBlockMaxTermFreq(size_t position) const {
+        return block_max_term_freqs_[position / BLOCK_SIZE];
+    }
+    // последний слот блока, содержащего позицию position
+    uint32_t GetBlockLastSlot(size_t position) const {
+        return slots_[std::min((position / BLOCK_SIZE + 1) * BLOCK_SIZE, slots_.size()) - 1];
+    }
+    // действительно до следующего изменения списка
+    PostingSpan GetSpan() const {
+        return {slots_.data(), term_freqs_.data(), block_max_term_freqs_.data(), slots_.size(), max_term_freq_};
+    }
+
+private:
+    std::vector<uint32_t> slots_;
+    std::vector<float> term_freqs_;
+    std::vector<float> block_max_term_freqs_;
+    float max_term_freq_ = 0;
+
+    // пересчитывает максимумы блоков, начиная с блока позиции position
+    void UpdateBlockMaxes(size_t position);
+};
+
+template <typename Predicate>
+size_t PostingList::RemoveIf(Predicate predicate) {
+    size_t kept = 0;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (!predicate(slots_[i])) {
+            slots_[kept] = slots_[i];
+            term_freqs_[kept] = term_freqs_[i];
+            ++kept;
+        }
+    }
+    const size_t removed = slots_.size() - kept;
+    if (removed > 0) {
+        slots_.resize(kept);
+        term_freqs_.resize(kept);
+        UpdateBlockMaxes(0);
+        max_term_freq_ = block_max_term_freqs_.empty() ? 0 : *std::max_element(block_max_term_freqs_.begin(), block_max_term_freqs_.end());
+    }
+    return removed;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Представление списка вхождений без владения данными: слоты по возрастанию, их TF
+// и максимумы TF блоков по BLOCK_SIZE вхождений. Так одинаково читаются и изменяемый
+// PostingList, и плоские массивы IndexSegment.
+class PostingSpan {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    PostingSpan() = default;
+    PostingSpan(const uint32_t* slots, const float* term_freqs, const float* block_max_term_freqs, size_t size, float max_term_freq)
+        : slots_(slots), term_freqs_(term_freqs), block_max_term_freqs_(block_max_term_freqs),
+          size_(size), max_term_freq_(max_term_freq) {
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    const uint32_t* GetSlots() const {
+        return slots_;
+    }
+    const float* GetTermFreqs() const {
+        return term_freqs_;
+    }
+    float GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+    // точный максимум TF в блоке, содержащем позицию position
+    float GetBlockMaxTermFreq(size_t position) const {
+        return block_max_term_freqs_[position / BLOCK_SIZE];
+    }
+    // последний слот блока, содержащего позицию position
+    uint32_t GetBlockLastSlot(size_t position) const {
+        return slots_[std::min((position / BLOCK_SIZE + 1) * BLOCK_SIZE, size_) - 1];
+    }
+
+    // первая позиция не раньше position, слот в которой не меньше slot
+    size_t Seek(size_t position, uint32_t slot) const {
+        // экспоненциальный поиск: курсоры обычно сдвигаются недалеко от текущей позиции
+        size_t bound = position;
+        size_t step = 1;
+        while (bound < size_ && slots_[bound] < slot) {
+            position = bound + 1;
+            bound += step;
+            step *= 2;
+        }
+        return std::lower_bound(slots_ + position, slots_ + std::min(bound, size_), slot) - slots_;
+    }
+
+private:
+    const uint32_t* slots_ = nullptr;
+    const float* term_freqs_ = nullptr;
+    const float* block_max_term_freqs_ = nullptr;
+    size_t size_ = 0;
+    float max_term_freq_ = 0;
+};
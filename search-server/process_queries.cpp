@@ -11,14 +11,15 @@ std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_ser
     return result;
 }
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries){
-    std::list<Document> result;
-    for (auto &docs : ProcessQueries(search_server, queries)){
-        for (auto &doc : docs){
-            result.push_back(std::move(doc));
-        }
-    }
-    return result;
+JoinedResults ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries){
+    // выдача запроса с окном по умолчанию не длиннее MAX_RESULT_DOCUMENT_COUNT документов
+    return JoinedResults::Collect(queries.size(), MAX_RESULT_DOCUMENT_COUNT, [&search_server, &queries](size_t query_index, Document* out) {
+        const std::vector<Document> documents = search_server.FindTopDocuments(queries[query_index]);
+        std::copy(documents.begin(), documents.end(), out);
+        return documents.size();
+    });
 }
 
-
+std::vector<std::vector<Document>> ProcessQueriesBatched(const SearchServer& search_server, const std::vector<std::string>& queries){
+    return search_server.FindTopDocumentsBatch(queries);
+}
@@ -1,9 +1,64 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <list>
+#include <future>
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <thread>
 #include "document.h"
+#include "joined_results.h"
 #include "search_server.h"
+
+// столько запросов на поток в одном окне ProcessQueriesStreamed
+const size_t STREAMED_QUERIES_PER_THREAD = 16;
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+JoinedResults ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// то же, что ProcessQueries, но пакетом: список вхождений каждого термина обходится один раз
+std::vector<std::vector<Document>> ProcessQueriesBatched(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// Выполняет запросы окнами и передает выдачу каждого в callback(номер запроса, выдача)
+// в порядке запросов и в вызывающем потоке. Пока callback разбирает окно, следующее уже
+// считается, а в памяти держатся только выдачи двух окон. Ошибка запроса бросается
+// на его месте в порядке: выдачи предыдущих запросов уже переданы
+template <typename Callback>
+void ProcessQueriesStreamed(const SearchServer& search_server, const std::vector<std::string>& queries, Callback callback){
+    struct QueryResult {
+        std::vector<Document> documents;
+        std::exception_ptr error;
+    };
+    const size_t window = std::max(1u, std::thread::hardware_concurrency()) * STREAMED_QUERIES_PER_THREAD;
+    const auto process_window = [&search_server, &queries, window](size_t window_begin) {
+        const size_t window_end = std::min(queries.size(), window_begin + window);
+        std::vector<QueryResult> results(window_end - window_begin);
+        // исключение не может покинуть параллельный алгоритм и передается вызывающему
+        std::transform(std::execution::par,
+                       queries.begin() + window_begin, queries.begin() + window_end, results.begin(),
+                       [&search_server](const std::string& query){
+                           QueryResult result;
+                           try {
+                               result.documents = search_server.FindTopDocuments(query);
+                           } catch (...) {
+                               result.error = std::current_exception();
+                           }
+                           return result;});
+        return results;
+    };
+    std::future<std::vector<QueryResult>> next_window;
+    if (!queries.empty()) {
+        next_window = std::async(std::launch::async, process_window, 0);
+    }
+    for (size_t window_begin = 0; window_begin < queries.size(); window_begin += window) {
+        const std::vector<QueryResult> results = next_window.get();
+        if (window_begin + window < queries.size()) {
+            next_window = std::async(std::launch::async, process_window, window_begin + window);
+        }
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].error) std::rethrow_exception(results[i].error);
+            callback(window_begin + i, results[i].documents);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#include "query_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+QueryArena::QueryArena(std::pmr::memory_resource* upstream)
+    : upstream_(upstream) {
+}
+
+QueryArena::~QueryArena() {
+    Reset(upstream_);
+}
+
+QueryArena& QueryArena::ForThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+void QueryArena::Reset(std::pmr::memory_resource* upstream) {
+    for (const Chunk& chunk : chunks_) {
+        upstream_->deallocate(chunk.data, chunk.size, alignof(std::max_align_t));
+    }
+    chunks_.clear();
+    chunk_ = 0;
+    offset_ = 0;
+    upstream_ = upstream;
+}
+
+void* QueryArena::do_allocate(size_t bytes, size_t alignment) {
+    for (; chunk_ < chunks_.size(); ++chunk_, offset_ = 0) {
+        const Chunk& chunk = chunks_[chunk_];
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(chunk.data);
+        const uintptr_t aligned = (begin + offset_ + alignment - 1) & ~(uintptr_t{alignment} - 1);
+        if (aligned + bytes <= begin + chunk.size) {
+            offset_ = aligned - begin + bytes;
+            return reinterpret_cast<void*>(aligned);
+        }
+    }
+    // подходящего куска нет: новый кусок вдвое больше предыдущего и вмещает запрос
+    const size_t size = std::max({MIN_CHUNK_SIZE, chunks_.empty() ? size_t{0} : 2 * chunks_.back().size, bytes + alignment});
+    chunks_.push_back({static_cast<std::byte*>(upstream_->allocate(size, alignof(std::max_align_t))), size});
+    chunk_ = chunks_.size() - 1;
+    offset_ = 0;
+    return do_allocate(bytes, alignment);
+}
+
+QueryArena::Scope::Scope(QueryArena& arena)
+    : arena_(arena), chunk_(arena.chunk_), offset_(arena.offset_) {
+}
+
+QueryArena::Scope::~Scope() {
+    arena_.chunk_ = chunk_;
+    arena_.offset_ = offset_;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Арена для временных данных разбора запроса. Память берется у upstream кусками и не
+// возвращается до Reset: область Scope при выходе лишь откатывает позицию выделения,
+// поэтому в установившемся режиме запросы не обращаются к куче.
+class QueryArena : public std::pmr::memory_resource {
+public:
+    explicit QueryArena(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+    ~QueryArena() override;
+
+    // арена текущего потока
+    static QueryArena& ForThread();
+
+    // возвращает все куски прежнему upstream и дальше берет память у нового;
+    // вызывается вне областей Scope, в том числе тестами для подсчета выделений
+    void Reset(std::pmr::memory_resource* upstream);
+
+    // все выделенное в области освобождается при выходе из нее; области вкладываются как стек
+    class Scope {
+    public:
+        explicit Scope(QueryArena& arena = ForThread());
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+
+        std::pmr::memory_resource* GetResource() const {
+            return &arena_;
+        }
+
+    private:
+        QueryArena& arena_;
+        size_t chunk_;
+        size_t offset_;
+    };
+
+private:
+    static constexpr size_t MIN_CHUNK_SIZE = 4096;
+
+    struct Chunk {
+        std::byte* data;
+        size_t size;
+    };
+
+    std::pmr::memory_resource* upstream_;
+    std::vector<Chunk> chunks_;
+    // позиция выделения: номер куска и смещение в нем
+    size_t chunk_ = 0;
+    size_t offset_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
@@ -0,0 +1,99 @@
+#include "query_result_cache.h"
+#include <stdexcept>
+
+QueryResultCache::QueryResultCache(size_t max_bytes, size_t shard_count)
+    : max_bytes_(max_bytes), shard_count_(shard_count),
+      max_shard_bytes_(shard_count == 0 ? 0 : max_bytes / shard_count),
+      shards_(std::make_unique<Shard[]>(shard_count)) {
+    if (shard_count == 0) throw std::invalid_argument("Кэш запросов без шардов");
+}
+
+bool QueryResultCache::Find(const Key& key, uint64_t generation, std::vector<Document>& result) const {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mtx);
+    const auto itr = shard.index.find(key);
+    if (itr == shard.index.end()) {
+        ++misses_;
+        return false;
+    }
+    if (itr->second->generation != generation) {
+        if (itr->second->generation < generation) {
+            EraseEntry(shard, itr->second);
+        }
+        ++misses_;
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, itr->second);
+    result = itr->second->documents;
+    ++hits_;
+    return true;
+}
+
+void QueryResultCache::Insert(const Key& key, uint64_t generation, const std::vector<Document>& result) {
+    const size_t bytes = ComputeEntryBytes(key, result);
+    if (bytes > max_shard_bytes_) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mtx);
+    if (const auto itr = shard.index.find(key); itr != shard.index.end()) {
+        if (itr->second->generation > generation) {
+            return;
+        }
+        EraseEntry(shard, itr->second);
+    }
+    while (shard.bytes + bytes > max_shard_bytes_) {
+        EraseEntry(shard, std::prev(shard.entries.end()));
+    }
+    shard.entries.push_front({key, generation, result, bytes});
+    shard.index.emplace(key, shard.entries.begin());
+    shard.bytes += bytes;
+}
+
+void QueryResultCache::Clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard guard(shards_[i].mtx);
+        shards_[i].index.clear();
+        shards_[i].entries.clear();
+        shards_[i].bytes = 0;
+    }
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard guard(shards_[i].mtx);
+        stats.entries += shards_[i].entries.size();
+        stats.bytes += shards_[i].bytes;
+    }
+    return stats;
+}
+
+size_t QueryResultCache::KeyHash::operator()(const Key& key) const {
+    // FNV-1a по словам ключа
+    uint64_t hash = 14695981039346656037ull;
+    for (const uint32_t word : key) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const Key& key) const {
+    // старшие биты хэша, чтобы шард не коррелировал с корзиной внутри шарда
+    const uint64_t hash = KeyHash{}(key);
+    return shards_[(hash >> 32) % shard_count_];
+}
+
+size_t QueryResultCache::ComputeEntryBytes(const Key& key, const std::vector<Document>& documents) {
+    // оценка с учетом узла списка и элемента индекса, где ключ хранится второй раз
+    return sizeof(Entry) + 2 * key.size() * sizeof(uint32_t) + documents.size() * sizeof(Document)
+           + sizeof(Key) + 4 * sizeof(void*);
+}
+
+void QueryResultCache::EraseEntry(Shard& shard, std::list<Entry>::iterator itr) {
+    shard.bytes -= itr->bytes;
+    shard.index.erase(itr->key);
+    shard.entries.erase(itr);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// Кэш выдачи запросов, разбитый на независимые шарды с собственной LRU-очередью.
+// Записи помечаются поколением индекса: запись от другого поколения считается промахом.
+// Поколения только растут, поэтому запись старше запрошенной удаляется при обращении,
+// а более новую, от свежего снимка того же индекса, не вытесняет запрос по старому. Потокобезопасен.
+class QueryResultCache {
+public:
+    // нормализованный запрос вместе с фильтром и окном выдачи
+    using Key = std::vector<uint32_t>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    // max_bytes == 0 отключает кэш
+    explicit QueryResultCache(size_t max_bytes = 0, size_t shard_count = 16);
+    // копии сервера делят один кэш через shared_ptr
+    QueryResultCache(const QueryResultCache&) = delete;
+    QueryResultCache& operator=(const QueryResultCache&) = delete;
+
+    bool IsEnabled() const {
+        return max_bytes_ > 0;
+    }
+    bool Find(const Key& key, uint64_t generation, std::vector<Document>& result) const;
+    void Insert(const Key& key, uint64_t generation, const std::vector<Document>& result);
+    void Clear();
+    Stats GetStats() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct Entry {
+        Key key;
+        uint64_t generation;
+        std::vector<Document> documents;
+        size_t bytes;
+    };
+    struct Shard {
+        std::mutex mtx;
+        // в начале недавно использованные записи
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t bytes = 0;
+    };
+
+    size_t max_bytes_;
+    size_t shard_count_;
+    size_t max_shard_bytes_;
+    std::unique_ptr<Shard[]> shards_;
+    mutable std::atomic<uint64_t> hits_{0};
+    mutable std::atomic<uint64_t> misses_{0};
+
+    Shard& GetShard(const Key& key) const;
+    static size_t ComputeEntryBytes(const Key& key, const std::vector<Document>& documents);
+    static void EraseEntry(Shard& shard, std::list<Entry>::iterator itr);
+};
@@ -0,0 +1,39 @@
+#include "relevance_accumulator.h"
+
+RelevanceAccumulator::Lease::Lease()
+    : accumulator_(&ForThread()) {
+    if (accumulator_->is_leased_) {
+        own_ = std::make_unique<RelevanceAccumulator>();
+        accumulator_ = own_.get();
+    }
+    accumulator_->is_leased_ = true;
+}
+
+RelevanceAccumulator::Lease::~Lease() {
+    accumulator_->Clear();
+    accumulator_->is_leased_ = false;
+}
+
+void RelevanceAccumulator::Begin(size_t range_size, size_t posting_count) {
+    is_sparse_ = posting_count < range_size / SPARSE_ACCUMULATION_RATIO;
+    if (is_sparse_) {
+        contributions_.reserve(posting_count);
+    } else if (relevance_.size() < range_size) {
+        relevance_.resize(range_size, 0);
+        is_matched_.resize(range_size, false);
+    }
+}
+
+RelevanceAccumulator& RelevanceAccumulator::ForThread() {
+    thread_local RelevanceAccumulator accumulator;
+    return accumulator;
+}
+
+void RelevanceAccumulator::Clear() {
+    for (const uint32_t offset : matched_offsets_) {
+        relevance_[offset] = 0;
+        is_matched_[offset] = false;
+    }
+    matched_offsets_.clear();
+    contributions_.clear();
+}
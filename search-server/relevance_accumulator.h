@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// вхождений меньше диапазона слотов во столько раз: релевантность копится парами
+// (смещение, вклад), а не в плотных массивах на весь диапазон
+const size_t SPARSE_ACCUMULATION_RATIO = 16;
+
+// Накопитель релевантности для диапазона слотов. Плотные массивы переживают запрос и растут
+// до наибольшего диапазона, а после обхода обнуляются только в затронутых слотах,
+// поэтому запрос по редким словам не платит за размер диапазона.
+class RelevanceAccumulator {
+public:
+    // накопитель текущего потока; занятый накопитель (поиск из предиката документа)
+    // заменяется временным
+    class Lease {
+    public:
+        Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        RelevanceAccumulator& operator*() const {
+            return *accumulator_;
+        }
+        RelevanceAccumulator* operator->() const {
+            return accumulator_;
+        }
+
+    private:
+        std::unique_ptr<RelevanceAccumulator> own_;
+        RelevanceAccumulator* accumulator_;
+    };
+
+    // готовит накопитель к диапазону из range_size слотов, в который попадут
+    // не больше posting_count вхождений
+    void Begin(size_t range_size, size_t posting_count);
+
+    // вклады одного смещения складываются в порядке вызовов
+    void Add(uint32_t offset, double contribution) {
+        if (is_sparse_) {
+            contributions_.emplace_back(offset, contribution);
+            return;
+        }
+        relevance_[offset] += contribution;
+        if (!is_matched_[offset]) {
+            is_matched_[offset] = true;
+            matched_offsets_.push_back(offset);
+        }
+    }
+
+    // вызывает callback(offset, relevance) для каждого затронутого смещения и очищает накопитель
+    template <typename Callback>
+    void Finish(Callback callback) {
+        if (is_sparse_) {
+            // устойчивая сортировка сохраняет порядок вкладов, а значит, и сумму до бита
+            std::stable_sort(contributions_.begin(), contributions_.end(),
+                             [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+            for (size_t i = 0; i < contributions_.size();) {
+                const uint32_t offset = contributions_[i].first;
+                double relevance = 0;
+                for (; i < contributions_.size() && contributions_[i].first == offset; ++i) {
+                    relevance += contributions_[i].second;
+                }
+                callback(offset, relevance);
+            }
+        } else {
+            for (const uint32_t offset : matched_offsets_) {
+                callback(offset, relevance_[offset]);
+            }
+        }
+        Clear();
+    }
+
+private:
+    bool is_sparse_ = false;
+    std::vector<double> relevance_;
+    std::vector<bool> is_matched_;
+    std::vector<uint32_t> matched_offsets_;
+    std::vector<std::pair<uint32_t, double>> contributions_;
+    bool is_leased_ = false;
+
+    static RelevanceAccumulator& ForThread();
+    // обнуляет затронутые слоты; Lease вызывает его и тогда, когда обход прервало исключение
+    void Clear();
+};
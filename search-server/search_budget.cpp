@@ -0,0 +1,37 @@
+#include "search_budget.h"
+
+SearchBudget::SearchBudget(Clock::time_point deadline, ExpiryAction on_expiry)
+    : deadline_(deadline), on_expiry_(on_expiry) {
+}
+
+SearchBudget::SearchBudget(Clock::duration timeout, ExpiryAction on_expiry)
+    : SearchBudget(Clock::now() + timeout, on_expiry) {
+}
+
+void SearchBudget::Cancel() {
+    cancelled_.store(true, std::memory_order_relaxed);
+}
+
+bool SearchBudget::IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+}
+
+ExpiryAction SearchBudget::GetExpiryAction() const {
+    return on_expiry_;
+}
+
+bool SearchBudget::IsExhausted() const {
+    if (IsCancelled() || (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_)) {
+        interrupted_.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool SearchBudget::IsInterrupted() const {
+    return interrupted_.load(std::memory_order_relaxed);
+}
+
+bool SearchBudget::KeepsPartialResult() const {
+    return !IsCancelled() && on_expiry_ == ExpiryAction::RETURN_PARTIAL;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "document.h"
+
+// обход вхождений сверяется с бюджетом поиска раз в столько вхождений или документов
+const size_t BUDGET_CHECK_INTERVAL = 4096;
+
+// что делать, когда срок поиска истек
+enum class ExpiryAction {
+    // вернуть лучшие документы по уже обойденной части индекса
+    RETURN_PARTIAL,
+    // бросить system_error с кодом timed_out
+    CANCEL,
+};
+
+// Бюджет одного поиска: срок и флаг отмены, который можно поднять из другого потока.
+// Поиск проверяет бюджет по ходу обхода и прерывается, когда срок истек или поиск отменен.
+class SearchBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SearchBudget(Clock::time_point deadline = Clock::time_point::max(), ExpiryAction on_expiry = ExpiryAction::RETURN_PARTIAL);
+    explicit SearchBudget(Clock::duration timeout, ExpiryAction on_expiry = ExpiryAction::RETURN_PARTIAL);
+
+    // отмена всегда прерывает поиск с system_error с кодом operation_canceled
+    void Cancel();
+    bool IsCancelled() const;
+    ExpiryAction GetExpiryAction() const;
+
+    // true, если поиск пора прервать; запоминает, что поиск был прерван
+    bool IsExhausted() const;
+    // был ли прерван поиск с этим бюджетом
+    bool IsInterrupted() const;
+    // нужна ли выдача прерванного поиска: при отмене и ExpiryAction::CANCEL ее не собирают
+    bool KeepsPartialResult() const;
+
+private:
+    Clock::time_point deadline_;
+    ExpiryAction on_expiry_;
+    std::atomic<bool> cancelled_{false};
+    mutable std::atomic<bool> interrupted_{false};
+};
+
+// выдача поиска с бюджетом; неполная, если обход прерван по сроку
+struct BudgetedResult {
+    std::vector<Document> documents;
+    bool is_complete = true;
+};
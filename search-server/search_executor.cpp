@@ -0,0 +1,53 @@
+#include "search_executor.h"
+#include <algorithm>
+
+SearchExecutor::SearchExecutor(size_t thread_count) {
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this]() { Run(); });
+    }
+}
+
+SearchExecutor::~SearchExecutor() {
+    {
+        std::lock_guard lock(mtx_);
+        is_stopping_ = true;
+    }
+    has_tasks_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+SearchExecutor& SearchExecutor::Shared() {
+    static SearchExecutor executor(std::max(1u, std::thread::hardware_concurrency()));
+    return executor;
+}
+
+void SearchExecutor::Submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(mtx_);
+        tasks_.push_back(std::move(task));
+    }
+    has_tasks_.notify_one();
+}
+
+size_t SearchExecutor::GetThreadCount() const {
+    return threads_.size();
+}
+
+void SearchExecutor::Run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mtx_);
+            has_tasks_.wait(lock, [this]() { return is_stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
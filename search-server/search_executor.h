@@ -0,0 +1,35 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул с постоянным числом потоков и общей очередью задач. Асинхронные поиски занимают
+// не больше потоков пула, сколько бы их ни было запущено: лишние ждут в очереди.
+// Задача пула не должна ждать другую задачу того же пула.
+class SearchExecutor {
+public:
+    explicit SearchExecutor(size_t thread_count);
+    SearchExecutor(const SearchExecutor&) = delete;
+    SearchExecutor& operator=(const SearchExecutor&) = delete;
+    // выполняет задачи, оставшиеся в очереди, и останавливает потоки
+    ~SearchExecutor();
+
+    // общий пул с потоком на каждое аппаратное ядро
+    static SearchExecutor& Shared();
+
+    void Submit(std::function<void()> task);
+    size_t GetThreadCount() const;
+
+private:
+    std::mutex mtx_;
+    std::condition_variable has_tasks_;
+    std::deque<std::function<void()>> tasks_;
+    bool is_stopping_ = false;
+    std::vector<std::thread> threads_;
+
+    void Run();
+};
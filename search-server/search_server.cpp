@@ -1,51 +1,517 @@
 #include "search_server.h"
+#include <atomic>
 #include <numeric>
+#include <optional>
+#include <system_error>
+
+#include "index_file.h"
+#include "search_executor.h"
+
+namespace {
+
+// поколения уникальны среди всех серверов: копии, которые разошлись после изменений,
+// не получат чужих записей из общего кэша выдачи
+uint64_t NextGeneration() {
+    static std::atomic<uint64_t> last_generation{0};
+    return ++last_generation;
+}
+
+}  // namespace
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
     if (document_id < 0) throw std::invalid_argument("Документ с отрицательным ID");
-    if (documents_.count(document_id)) throw std::invalid_argument("Документ с повторным ID");
-    storage_.emplace_back(document);
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(storage_.back());
-    for (const auto word : words){
-        if (!IsValidWord(word)) throw std::invalid_argument("Недопустимый формат слов");
-    }
+    if (documents_.FindSlot(document_id) != DocumentTable::NO_SLOT) throw std::invalid_argument("Документ с повторным ID");
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
     const double inv_word_count = 1.0 / words.size();
+    std::map<TermId, double> term_freqs;
     for (const auto word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        word_freqs_[document_id][word] += inv_word_count;
+        term_freqs[terms_.Intern(word)] += inv_word_count;
+    }
+    const Slot slot = documents_.Add(document_id, ComputeAverageRating(ratings), status);
+    term_to_document_freqs_.resize(terms_.GetTermCount());
+    log_document_freqs_.resize(terms_.GetTermCount());
+    document_freqs_.resize(terms_.GetTermCount());
+    for (const auto [term_id, term_freq] : term_freqs) {
+        if (term_to_document_freqs_[term_id].empty()) {
+            mutable_terms_.push_back(term_id);
+        }
+        term_to_document_freqs_.Mutable(term_id).Add(slot, term_freq);
+        ++document_freqs_.Mutable(term_id);
+        UpdateDocumentFreq(term_id);
+    }
+    live_postings_ += term_freqs.size();
+    UpdateDocumentCount();
+    document_to_term_freqs_.push_back({term_freqs.begin(), term_freqs.end()});
+    generation_ = NextGeneration();
+    RefreshIfNeeded();
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::unordered_set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0) throw std::invalid_argument("Документ с отрицательным ID");
+        if (documents_.FindSlot(document.id) != DocumentTable::NO_SLOT || !batch_ids.insert(document.id).second) {
+            throw std::invalid_argument("Документ с повторным ID");
+        }
+    }
+
+    const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_count = std::clamp<size_t>(documents.size() / MIN_DOCUMENTS_PER_CHUNK, 1, thread_count * 4);
+    const auto chunk_begin = [&documents, chunk_count](size_t chunk) {
+        return documents.size() * chunk / chunk_count;
+    };
+    std::vector<PartialIndex> partial_indexes(chunk_count);
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        BuildPartialIndex(documents, chunk_begin(chunk), chunk_begin(chunk + 1), partial_indexes[chunk]);
+    });
+    // диапазоны идут по порядку, поэтому первой бросается ошибка самого раннего документа
+    for (const PartialIndex& index : partial_indexes) {
+        if (index.error) std::rethrow_exception(index.error);
+    }
+
+    // словарь не потокобезопасен: термины получают глобальные идентификаторы последовательно
+    struct TermSource {
+        TermId term_id;
+        uint32_t chunk;
+        uint32_t local_id;
+    };
+    std::vector<TermSource> sources;
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        PartialIndex& index = partial_indexes[chunk];
+        index.global_ids.reserve(index.words.size());
+        for (uint32_t local_id = 0; local_id < index.words.size(); ++local_id) {
+            index.global_ids.push_back(terms_.Intern(index.words[local_id]));
+            sources.push_back({index.global_ids.back(), static_cast<uint32_t>(chunk), local_id});
+        }
+    }
+    std::stable_sort(sources.begin(), sources.end(),
+                     [](const TermSource& lhs, const TermSource& rhs) { return lhs.term_id < rhs.term_id; });
+
+    const Slot first_slot = static_cast<Slot>(documents_.GetSlotCount());
+    for (const NewDocument& document : documents) {
+        documents_.Add(document.id, ComputeAverageRating(document.ratings), document.status);
+    }
+    term_to_document_freqs_.resize(terms_.GetTermCount());
+    log_document_freqs_.resize(terms_.GetTermCount());
+    document_freqs_.resize(terms_.GetTermCount());
+    document_to_term_freqs_.resize(first_slot + documents.size());
+
+    // слияние списков вхождений: диапазоны пакета занимают идущие подряд слоты,
+    // так что вхождения термина из диапазонов дописываются в конец списка по порядку
+    std::vector<size_t> term_starts;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (i == 0 || sources[i].term_id != sources[i - 1].term_id) {
+            term_starts.push_back(i);
+        }
+    }
+    term_starts.push_back(sources.size());
+    // куски, общие со снимками, копируются здесь, а параллельная запись идет только в собственные
+    for (size_t i = 0; i + 1 < term_starts.size(); ++i) {
+        const TermId term_id = sources[term_starts[i]].term_id;
+        if (term_to_document_freqs_[term_id].empty()) {
+            mutable_terms_.push_back(term_id);
+        }
+        term_to_document_freqs_.MakeOwned(term_id);
+        document_freqs_.MakeOwned(term_id);
+        log_document_freqs_.MakeOwned(term_id);
+    }
+    std::vector<size_t> term_runs(term_starts.size() - 1);
+    std::iota(term_runs.begin(), term_runs.end(), 0);
+    std::for_each(std::execution::par, term_runs.begin(), term_runs.end(), [&](size_t run) {
+        const TermId term_id = sources[term_starts[run]].term_id;
+        PostingList& postings = term_to_document_freqs_.Mutable(term_id);
+        uint32_t& document_freq = document_freqs_.Mutable(term_id);
+        for (size_t i = term_starts[run]; i < term_starts[run + 1]; ++i) {
+            for (const auto& [index, term_freq] : partial_indexes[sources[i].chunk].postings[sources[i].local_id]) {
+                postings.Add(first_slot + static_cast<Slot>(index), term_freq);
+                ++document_freq;
+            }
+        }
+        UpdateDocumentFreq(term_id);
+    });
+
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        const PartialIndex& index = partial_indexes[chunk];
+        for (size_t i = 0; i < index.document_terms.size(); ++i) {
+            auto& document_terms = document_to_term_freqs_.Mutable(first_slot + chunk_begin(chunk) + i);
+            document_terms.reserve(index.document_terms[i].size());
+            for (const auto& [local_id, term_freq] : index.document_terms[i]) {
+                document_terms.emplace_back(index.global_ids[local_id], term_freq);
+            }
+            std::sort(document_terms.begin(), document_terms.end());
+        }
+    });
+
+    for (const PartialIndex& index : partial_indexes) {
+        for (const auto& document_terms : index.document_terms) {
+            live_postings_ += document_terms.size();
+        }
+    }
+    UpdateDocumentCount();
+    generation_ = NextGeneration();
+    RefreshIfNeeded();
+}
+
+void SearchServer::BuildPartialIndex(const std::vector<NewDocument>& documents, size_t first, size_t last, PartialIndex& index) const {
+    // исключение из параллельного алгоритма завершило бы программу, поэтому ошибка сохраняется
+    try {
+        std::vector<uint32_t> local_ids;
+        for (size_t i = first; i < last; ++i) {
+            const std::vector<std::string_view> words = SplitIntoWordsNoStop(documents[i].text);
+            local_ids.clear();
+            for (const auto word : words) {
+                const auto [itr, inserted] = index.local_ids.emplace(word, static_cast<uint32_t>(index.words.size()));
+                if (inserted) {
+                    index.words.push_back(word);
+                    index.postings.emplace_back();
+                }
+                local_ids.push_back(itr->second);
+            }
+            std::sort(local_ids.begin(), local_ids.end());
+            // TF накапливается так же, как в AddDocument, чтобы значения совпадали до бита
+            const double inv_word_count = 1.0 / words.size();
+            auto& document_terms = index.document_terms.emplace_back();
+            for (size_t j = 0; j < local_ids.size(); ++j) {
+                if (j == 0 || local_ids[j] != local_ids[j - 1]) {
+                    document_terms.emplace_back(local_ids[j], 0.0);
+                }
+                document_terms.back().second += inv_word_count;
+            }
+            for (const auto& [local_id, term_freq] : document_terms) {
+                index.postings[local_id].emplace_back(i, term_freq);
+            }
+        }
+    } catch (...) {
+        index.error = std::current_exception();
     }
-    ids_.emplace(document_id);
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const{
-    return FindTopDocuments(std::execution::seq, raw_query,  [status](int , DocumentStatus document_status, int ) {
-        return document_status == status;
+    return FindTopDocuments(std::execution::seq, raw_query, status, SearchOptions{});
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const{
+    return FindTopDocuments(std::execution::seq, raw_query, status, options);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const{
+    return FindTopDocuments(std::execution::seq, raw_query, filter, SearchOptions{});
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options) const{
+    return FindTopDocuments(std::execution::seq, raw_query, filter, options);
+}
+
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status,
+                                                                     const SearchOptions& options) const {
+    std::vector<Query> queries;
+    queries.reserve(raw_queries.size());
+    for (const std::string& raw_query : raw_queries) {
+        queries.push_back(ParseQuery(raw_query, std::pmr::get_default_resource()));
+    }
+
+    // использования терминов запросами, сгруппированные по терминам; группы упорядочены по словам,
+    // как плюс-слова в запросе, и обратная частота считается один раз на группу
+    struct TermUse {
+        TermId term_id;
+        uint32_t query_index;
+    };
+    std::vector<TermUse> uses;
+    for (uint32_t query_index = 0; query_index < queries.size(); ++query_index) {
+        for (const TermId term_id : queries[query_index].plus_terms) {
+            uses.push_back({term_id, query_index});
+        }
+    }
+    std::sort(uses.begin(), uses.end(), [](const TermUse& lhs, const TermUse& rhs) {
+        return lhs.term_id < rhs.term_id || (lhs.term_id == rhs.term_id && lhs.query_index < rhs.query_index);
+    });
+    // блок обходит списки термина один раз за все свои запросы с ним; когда запросы почти не делят
+    // термины, общий обход не окупает плиток, и пакет выполняется по запросам
+    size_t block_term_count = 0;
+    for (size_t i = 0; i < uses.size(); ++i) {
+        if (i == 0 || uses[i].term_id != uses[i - 1].term_id
+            || uses[i].query_index / BATCH_QUERY_BLOCK != uses[i - 1].query_index / BATCH_QUERY_BLOCK) {
+            ++block_term_count;
+        }
+    }
+    if (uses.size() < BATCH_MIN_QUERIES_PER_TERM * block_term_count) {
+        SearchOptions query_options = options;
+        query_options.mode = EvaluationMode::EXHAUSTIVE;
+        query_options.stats = nullptr;
+        DocumentFilter query_filter;
+        query_filter.statuses.push_back(status);
+        std::vector<std::vector<Document>> results(queries.size());
+        std::transform(std::execution::par, queries.begin(), queries.end(), results.begin(), [&](const Query& query) {
+            return FindFilteredDocuments(std::execution::seq, query, query_filter, query_options, nullptr);
+        });
+        return results;
+    }
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i = 0; i < uses.size(); ++i) {
+        if (i == 0 || uses[i].term_id != uses[i - 1].term_id) {
+            groups.emplace_back(i, i);
+        }
+        groups.back().second = i + 1;
+    }
+    std::sort(groups.begin(), groups.end(), [this, &uses](const auto& lhs, const auto& rhs) {
+        return terms_.GetTerm(uses[lhs.first].term_id) < terms_.GetTerm(uses[rhs.first].term_id);
+    });
+    std::vector<double> inverse_document_freqs(groups.size());
+    for (size_t group = 0; group < groups.size(); ++group) {
+        inverse_document_freqs[group] = ComputeWordInverseDocumentFreq(uses[groups[group].first].term_id);
+    }
+
+    // статусы проверяются по одной на весь пакет битовой карте, минус-слова - только у найденных документов
+    DocumentFilter filter;
+    filter.statuses.push_back(status);
+    const SlotBitmap candidates = documents_.Select(filter);
+
+    // блоки запросов обрабатываются параллельно. Блок проходит слоты узкими диапазонами, в которых
+    // есть его вхождения, и обходит вхождения каждого своего термина один раз, складывая вклад во все запросы блока с этим термином;
+    // накопитель хранит строку запросов блока на слот, так что они рядом в памяти и помещаются в кэш
+    const size_t capacity = options.offset + std::min(options.top_k, std::numeric_limits<size_t>::max() - options.offset);
+    const size_t slot_count = documents_.GetSlotCount();
+    std::vector<std::vector<Document>> results(queries.size());
+    std::vector<size_t> blocks((queries.size() + BATCH_QUERY_BLOCK - 1) / BATCH_QUERY_BLOCK);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](size_t block) {
+        const size_t block_begin = block * BATCH_QUERY_BLOCK;
+        const size_t block_size = std::min(BATCH_QUERY_BLOCK, queries.size() - block_begin);
+        // термины блока с их запросами, в порядке слов
+        std::vector<std::pair<size_t, std::pair<size_t, size_t>>> block_groups;
+        const auto use_less = [](const TermUse& use, size_t query_index) { return use.query_index < query_index; };
+        for (size_t group = 0; group < groups.size(); ++group) {
+            const auto block_uses_begin = std::lower_bound(uses.begin() + groups[group].first, uses.begin() + groups[group].second,
+                                                           block_begin, use_less);
+            const auto block_uses_end = std::lower_bound(block_uses_begin, uses.begin() + groups[group].second,
+                                                         block_begin + block_size, use_less);
+            if (block_uses_begin != block_uses_end) {
+                block_groups.push_back({group, {block_uses_begin - uses.begin(), block_uses_end - uses.begin()}});
+            }
+        }
+
+        // курсор термина блока проходит его списки по возрастанию слотов один раз за весь обход
+        struct TermCursor {
+            size_t group;
+            size_t uses_begin;
+            size_t uses_end;
+            size_t span;
+            size_t spans_end;
+            size_t position = 0;
+        };
+        const QueryArena::Scope arena_scope;
+        std::vector<PostingSpan> spans;
+        std::vector<TermCursor> cursors;
+        cursors.reserve(block_groups.size());
+        for (const auto& [group, group_uses] : block_groups) {
+            const size_t spans_begin = spans.size();
+            ForEachPostingSpan(uses[group_uses.first].term_id, 0, static_cast<Slot>(slot_count), [&spans](const PostingSpan& postings) {
+                if (!postings.empty()) {
+                    spans.push_back(postings);
+                }
+            });
+            if (spans_begin < spans.size()) {
+                cursors.push_back({group, group_uses.first, group_uses.second, spans_begin, spans.size()});
+            }
+        }
+        // курсор ждет в корзине плитки со своим следующим вхождением: плитки без вхождений
+        // блока пропускаются целиком
+        std::vector<std::vector<uint32_t>> tile_cursors((slot_count + BATCH_TILE_SLOTS - 1) / BATCH_TILE_SLOTS);
+        const auto wait_for_next_tile = [&spans, &cursors, &tile_cursors](uint32_t cursor) {
+            tile_cursors[spans[cursors[cursor].span].GetSlots()[cursors[cursor].position] / BATCH_TILE_SLOTS].push_back(cursor);
+        };
+        for (uint32_t cursor = 0; cursor < cursors.size() && capacity > 0; ++cursor) {
+            wait_for_next_tile(cursor);
+        }
+
+        std::vector<double> relevance(BATCH_TILE_SLOTS * block_size, 0);
+        std::vector<uint8_t> is_matched(relevance.size(), 0);
+        // затронутые ячейки плитки; ячейка дописывается без ветвления, а счетчик растет только для новой,
+        // поэтому запись идет и за последнюю затронутую ячейку
+        std::vector<uint32_t> touched_cells(relevance.size() + 1);
+        size_t touched_count = 0;
+        std::vector<uint32_t> current_cursors;
+        std::vector<double> thresholds(block_size, -std::numeric_limits<double>::infinity());
+        for (size_t tile = 0; tile < tile_cursors.size(); ++tile) {
+            if (tile_cursors[tile].empty()) {
+                continue;
+            }
+            const Slot first = static_cast<Slot>(tile * BATCH_TILE_SLOTS);
+            const Slot last = static_cast<Slot>(std::min(slot_count, size_t{first} + BATCH_TILE_SLOTS));
+            current_cursors.swap(tile_cursors[tile]);
+            // курсоры идут в порядке слов, поэтому каждый запрос получает вклады в порядке своих слов,
+            // как в FindDocumentsInRange, и суммы релевантности совпадают до бита
+            std::sort(current_cursors.begin(), current_cursors.end());
+            for (const uint32_t cursor_index : current_cursors) {
+                TermCursor& cursor = cursors[cursor_index];
+                const double inverse_document_freq = inverse_document_freqs[cursor.group];
+                for (; cursor.span < cursor.spans_end; ++cursor.span, cursor.position = 0) {
+                    const PostingSpan& postings = spans[cursor.span];
+                    const uint32_t* const slots = postings.GetSlots();
+                    const float* const term_freqs = postings.GetTermFreqs();
+                    size_t position = cursor.position;
+                    for (; position < postings.size() && slots[position] < last; ++position) {
+                        const Slot slot = slots[position];
+                        if (!candidates.Test(slot)) {
+                            continue;
+                        }
+                        const double contribution = term_freqs[position] * inverse_document_freq;
+                        const size_t row = (slot - first) * block_size;
+                        for (size_t use = cursor.uses_begin; use < cursor.uses_end; ++use) {
+                            const size_t cell = row + uses[use].query_index - block_begin;
+                            relevance[cell] += contribution;
+                            touched_cells[touched_count] = static_cast<uint32_t>(cell);
+                            touched_count += is_matched[cell] ^ 1;
+                            is_matched[cell] = 1;
+                        }
+                    }
+                    cursor.position = position;
+                    if (position < postings.size()) {
+                        break;
+                    }
+                }
+                if (cursor.span < cursor.spans_end) {
+                    wait_for_next_tile(cursor_index);
+                }
+            }
+
+            // куча каждого запроса держит наименее релевантный документ выдачи на вершине; документ
+            // с релевантностью ниже порога проигрывает ему при любом рейтинге и отсекается сразу
+            const auto take_cell = [&](Slot slot, size_t query, double document_relevance) {
+                if (IsExcluded(queries[block_begin + query], slot)) {
+                    return;
+                }
+                const Document document(documents_.GetId(slot), document_relevance, documents_.GetRating(slot));
+                std::vector<Document>& top_documents = results[block_begin + query];
+                if (top_documents.size() < capacity) {
+                    top_documents.push_back(document);
+                } else if (IsMoreRelevant(document, top_documents.front())) {
+                    std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                    top_documents.back() = document;
+                } else {
+                    return;
+                }
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                if (top_documents.size() == capacity) {
+                    thresholds[query] = top_documents.front().relevance - EPSILON;
+                }
+            };
+            // ячейки разбираются в порядке слотов, как при полном проходе плитки: немногие затронутые
+            // сортируются и обнуляются по одной, а плотную плитку дешевле пройти целиком и обнулить разом.
+            // Порог проверяется первым: он отсекает и большинство ненайденных ячеек, у которых релевантность 0
+            const size_t tile_cells = (last - first) * block_size;
+            if (touched_count * SPARSE_ACCUMULATION_RATIO < tile_cells) {
+                std::sort(touched_cells.begin(), touched_cells.begin() + touched_count);
+                for (size_t i = 0; i < touched_count; ++i) {
+                    const uint32_t cell = touched_cells[i];
+                    const size_t query = cell % block_size;
+                    if (relevance[cell] >= thresholds[query]) {
+                        take_cell(first + static_cast<Slot>(cell / block_size), query, relevance[cell]);
+                    }
+                    relevance[cell] = 0;
+                    is_matched[cell] = 0;
+                }
+            } else {
+                for (Slot slot = first; slot < last; ++slot) {
+                    const size_t row = (slot - first) * block_size;
+                    for (size_t query = 0; query < block_size; ++query) {
+                        if (relevance[row + query] >= thresholds[query] && is_matched[row + query]) {
+                            take_cell(slot, query, relevance[row + query]);
+                        }
+                    }
+                }
+                std::fill(relevance.begin(), relevance.begin() + tile_cells, 0);
+                std::fill(is_matched.begin(), is_matched.begin() + tile_cells, 0);
+            }
+            touched_count = 0;
+            current_cursors.clear();
+        }
+
+        for (size_t query = 0; query < block_size; ++query) {
+            std::vector<Document>& top_documents = results[block_begin + query];
+            std::sort_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            top_documents.erase(top_documents.begin(), top_documents.begin() + std::min(options.offset, top_documents.size()));
+        }
+    });
+    return results;
+}
+
+BudgetedResult SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options,
+                                              const SearchBudget& budget) const {
+    DocumentFilter filter;
+    filter.statuses.push_back(status);
+    BudgetedResult result;
+    if (!budget.IsExhausted()) {
+        result.documents = FindTopDocuments(std::execution::seq, raw_query, filter, options, &budget);
+    }
+    if (budget.IsInterrupted()) {
+        if (budget.IsCancelled()) {
+            throw std::system_error(std::make_error_code(std::errc::operation_canceled), "Поиск отменен");
+        }
+        if (budget.GetExpiryAction() == ExpiryAction::CANCEL) {
+            throw std::system_error(std::make_error_code(std::errc::timed_out), "Срок поиска истек");
+        }
+        result.is_complete = false;
+    }
+    return result;
+}
+
+std::future<BudgetedResult> SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentStatus status, const SearchOptions& options,
+                                                                std::shared_ptr<SearchBudget> budget) const {
+    {
+        std::lock_guard lock(pending_searches_.mtx);
+        ++pending_searches_.count;
+    }
+    auto task = std::make_shared<std::packaged_task<BudgetedResult()>>(
+        [this, raw_query = std::move(raw_query), status, options, budget = std::move(budget)]() {
+            return FindTopDocuments(raw_query, status, options, *budget);
+        });
+    std::future<BudgetedResult> result = task->get_future();
+    SearchExecutor::Shared().Submit([this, task]() {
+        (*task)();
+        std::lock_guard lock(pending_searches_.mtx);
+        if (--pending_searches_.count == 0) {
+            pending_searches_.finished.notify_all();
+        }
     });
+    return result;
+}
+
+SearchServer::PendingSearches::~PendingSearches() {
+    std::unique_lock lock(mtx);
+    finished.wait(lock, [this]() { return count == 0; });
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return documents_.GetDocumentCount();
 }
 
 int SearchServer::GetDocumentId(int index) const {
-    if (index < 0 || index > documents_.size()) throw std::out_of_range("Индекс переходит за допустимый диапазон");
-    auto it = documents_.begin();
-    advance(it, index);
-    return it->first;
+    if (index < 0 || index >= GetDocumentCount()) throw std::out_of_range("Индекс переходит за допустимый диапазон");
+    return documents_.GetSortedIds()[index];
 }
 
-std::set<int>::const_iterator SearchServer::begin(){
-    return ids_.begin();
+std::vector<int>::const_iterator SearchServer::begin(){
+    return documents_.GetSortedIds().begin();
 }
 
-std::set<int>::const_iterator SearchServer::end(){
-    return ids_.end();
+std::vector<int>::const_iterator SearchServer::end(){
+    return documents_.GetSortedIds().end();
 }
 
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const{
-    if (ids_.count(document_id)) {
-        return word_freqs_.at(document_id);
+    const Slot slot = documents_.FindSlot(document_id);
+    if (slot != DocumentTable::NO_SLOT) {
+        std::lock_guard guard(word_freqs_.mtx);
+        auto [itr, inserted] = word_freqs_.freqs.try_emplace(document_id);
+        if (inserted) {
+            for (const auto& [term_id, term_freq] : document_to_term_freqs_[slot]) {
+                itr->second.emplace(terms_.GetTerm(term_id), term_freq);
+            }
+        }
+        return itr->second;
     }
     static std::map<std::string_view, double> res_s{};
     return res_s;;
@@ -56,47 +522,316 @@ void SearchServer::RemoveDocument(int document_id){
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy, int document_id){
-    if (!ids_.count(document_id)) {
+    const Slot slot = documents_.FindSlot(document_id);
+    if (slot == DocumentTable::NO_SLOT) {
         throw std::out_of_range("Документа с указанным id не существует.");
     }
-    for (const auto [word, _ ] :  GetWordFrequencies(document_id)) {
-        word_to_document_freqs_[word].erase(document_id);
-    }
-    ids_.erase(document_id);
-    word_freqs_.erase(document_id);
-    documents_.erase(document_id);
+    // запросы отбрасывают документ по признаку жизни слота сразу, а его термины
+    // уходят из статистики и списков вхождений позже, пачкой (см. Maintain)
+    documents_.Remove(slot);
+    word_freqs_.freqs.erase(document_id);
+    removed_slots_.push_back(slot);
+    generation_ = NextGeneration();
 }
 
 void SearchServer::RemoveDocument(std::execution::parallel_policy, int document_id){
-    if (!ids_.count(document_id)) {
-        throw std::out_of_range("Документа с указанным id не существует.");
+    // удаление стоит O(1), и распараллеливать в нем нечего
+    RemoveDocument(std::execution::seq, document_id);
+}
+
+void SearchServer::EnableResultCache(size_t max_bytes, size_t shard_count) {
+    result_cache_ = std::make_shared<QueryResultCache>(max_bytes, shard_count);
+}
+
+void SearchServer::DisableResultCache() {
+    result_cache_ = std::make_shared<QueryResultCache>();
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_->GetStats();
+}
+
+void SearchServer::Maintain() {
+    ApplyRemovals();
+    MergeSegments(std::numeric_limits<size_t>::max());
+    CompactPostingsIfNeeded();
+    // уплотнение освобождает термины, и их строки переносятся здесь же, а не в изменениях
+    if (terms_.NeedsCompaction()) {
+        CompactStorage();
     }
+}
 
-    auto document_words = GetWordFrequencies(document_id);
-    std::vector<std::string_view> words(document_words.size());
-    std::transform(std::execution::par, document_words.begin(), document_words.end(),
-                   words.begin(),
-                   [](auto word){
-                       return word.first;
-                   });
+size_t SearchServer::GetPendingRemovalCount() const {
+    return removed_slots_.size();
+}
+
+void SearchServer::CompactPostings() {
+    ApplyRemovals();
+    if (dead_postings_ == 0) {
+        return;
+    }
+    const auto is_alive = [this](Slot slot) { return documents_.IsAlive(slot); };
+    // изменяемый сегмент невелик, и его списки проверяются целиком
+    for (const TermId term_id : mutable_terms_) {
+        term_to_document_freqs_.MakeOwned(term_id);
+    }
+    std::for_each(std::execution::par, mutable_terms_.begin(), mutable_terms_.end(), [this, &is_alive](TermId term_id) {
+        term_to_document_freqs_.Mutable(term_id).RemoveIf([&is_alive](Slot slot) { return !is_alive(slot); });
+    });
+    mutable_terms_.erase(std::remove_if(mutable_terms_.begin(), mutable_terms_.end(),
+                                        [this](TermId term_id) { return term_to_document_freqs_[term_id].empty(); }),
+                         mutable_terms_.end());
+    // сегмент с удаленными вхождениями заменяется новым, а старый остается у снимков, что его держат
+    std::for_each(std::execution::par, segments_.begin(), segments_.end(), [this, &is_alive](SegmentRef& ref) {
+        if (ref.dead_postings > 0) {
+            ref.segment = ShareSegment(IndexSegment::Merge({ref.segment.get()}, is_alive));
+            ref.dead_postings = 0;
+        }
+    });
 
-    std::for_each(std::execution::par,
-                  words.begin(), words.end(),
-                  [this, document_id](auto word){
-                      word_to_document_freqs_[word].erase(document_id);
-                  });
-    ids_.erase(document_id);
-    word_freqs_.erase(document_id);
-    documents_.erase(document_id);
+    // вхождений у терминов без документов больше нет нигде, и их идентификаторы получат новые слова
+    std::sort(orphan_terms_.begin(), orphan_terms_.end());
+    orphan_terms_.erase(std::unique(orphan_terms_.begin(), orphan_terms_.end()), orphan_terms_.end());
+    for (const TermId term_id : orphan_terms_) {
+        if (document_freqs_[term_id] == 0) {
+            terms_.Release(term_id);
+        }
+    }
+    orphan_terms_.clear();
+    dead_postings_ = 0;
+}
+
+size_t SearchServer::GetDeadPostingCount() const {
+    return dead_postings_;
+}
+
+void SearchServer::Refresh() {
+    // слияние сегментов ведет счетчики мертвых вхождений, поэтому удаления учитываются до него
+    ApplyRemovals();
+    const Slot last_slot = static_cast<Slot>(documents_.GetSlotCount());
+    if (last_slot == mutable_first_slot_) {
+        return;
+    }
+    size_t dropped_postings = 0;
+    IndexSegment segment = FreezeMutableSegment(dropped_postings);
+    for (const TermId term_id : mutable_terms_) {
+        term_to_document_freqs_.Mutable(term_id).Clear();
+    }
+    mutable_terms_.clear();
+    dead_postings_ -= dropped_postings;
+    segments_.push_back({ShareSegment(std::move(segment)), 0});
+    mutable_first_slot_ = last_slot;
+    // слияния на пути записи ограничены, чтобы каскад не задерживал добавление надолго
+    MergeSegments(MERGE_REFRESH_INTERVALS_PER_REFRESH * std::max<size_t>(refresh_interval_, 1));
+}
+
+void SearchServer::SetRefreshInterval(size_t document_count) {
+    refresh_interval_ = document_count;
+    RefreshIfNeeded();
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return segments_.size();
+}
+
+void SearchServer::SetPostingCompression(bool is_compressed) {
+    is_posting_compression_ = is_compressed;
+    // сегмент переписывается в копию: старый остается у снимков, что его держат
+    std::for_each(std::execution::par, segments_.begin(), segments_.end(), [is_compressed](SegmentRef& ref) {
+        if (ref.segment->IsCompressed() != is_compressed) {
+            IndexSegment segment = *ref.segment;
+            if (is_compressed) {
+                segment.Compress();
+            } else {
+                segment.Decompress();
+            }
+            ref.segment = std::make_shared<const IndexSegment>(std::move(segment));
+        }
+    });
+}
+
+size_t SearchServer::GetPostingStorageBytes() const {
+    size_t bytes = 0;
+    for (const SegmentRef& ref : segments_) {
+        bytes += ref.segment->GetPostingBytes();
+    }
+    return bytes;
+}
+
+void SearchServer::Save(const std::string& path) const {
+    IndexFileWriter writer(path);
+    // изменяемый сегмент сохраняется замороженным, и загруженный сервер начинает с пустого
+    size_t dropped_postings = 0;
+    std::optional<IndexSegment> mutable_segment;
+    if (mutable_first_slot_ < documents_.GetSlotCount()) {
+        mutable_segment = FreezeMutableSegment(dropped_postings);
+    }
+
+    writer.BeginSection(IndexSectionKind::SERVER);
+    std::vector<uint64_t> stop_word_offsets = {0};
+    std::vector<char> stop_word_text;
+    for (const std::string& word : stop_words_) {
+        stop_word_text.insert(stop_word_text.end(), word.begin(), word.end());
+        stop_word_offsets.push_back(stop_word_text.size());
+    }
+    writer.WriteArray(stop_word_offsets);
+    writer.WriteArray(stop_word_text);
+    terms_.Save(writer);
+    documents_.Save(writer);
+    writer.WriteArray(document_freqs_.ToVector());
+    writer.WriteArray(orphan_terms_);
+    writer.Write<uint64_t>(live_postings_);
+    writer.Write<uint64_t>(dead_postings_ - dropped_postings);
+    writer.Write<uint64_t>(refresh_interval_);
+    // прямой индекс хранится плоско: термины слота slot занимают [offsets[slot], offsets[slot + 1])
+    std::vector<uint64_t> forward_offsets = {0};
+    std::vector<TermId> forward_terms;
+    std::vector<double> forward_term_freqs;
+    for (size_t slot = 0; slot < document_to_term_freqs_.size(); ++slot) {
+        for (const auto& [term_id, term_freq] : document_to_term_freqs_[slot]) {
+            forward_terms.push_back(term_id);
+            forward_term_freqs.push_back(term_freq);
+        }
+        forward_offsets.push_back(forward_terms.size());
+    }
+    writer.WriteArray(forward_offsets);
+    writer.WriteArray(forward_terms);
+    writer.WriteArray(forward_term_freqs);
+    std::vector<uint64_t> segment_dead_postings;
+    for (const SegmentRef& ref : segments_) {
+        segment_dead_postings.push_back(ref.dead_postings);
+    }
+    if (mutable_segment) {
+        segment_dead_postings.push_back(0);
+    }
+    writer.WriteArray(segment_dead_postings);
+    writer.EndSection();
+
+    for (const SegmentRef& ref : segments_) {
+        writer.BeginSection(IndexSectionKind::SEGMENT);
+        ref.segment->Save(writer);
+        writer.EndSection();
+    }
+    if (mutable_segment) {
+        writer.BeginSection(IndexSectionKind::SEGMENT);
+        mutable_segment->Save(writer);
+        writer.EndSection();
+    }
+    writer.Finish();
+}
+
+SearchServer SearchServer::Load(const std::string& path, const LoadOptions& options) {
+    const IndexFileReader reader(path);
+    if (reader.GetSectionCount() == 0 || reader.GetSectionKind(0) != IndexSectionKind::SERVER) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    IndexSectionReader section = reader.OpenSection(0, true);
+    const auto stop_word_offsets = section.ReadArray<uint64_t>();
+    const auto stop_word_text = section.ReadArray<char>();
+    std::vector<std::string> stop_words;
+    for (size_t i = 0; i + 1 < stop_word_offsets.size; ++i) {
+        if (stop_word_offsets[i] > stop_word_offsets[i + 1] || stop_word_offsets[i + 1] > stop_word_text.size) {
+            throw std::runtime_error("Поврежден файл индекса " + path);
+        }
+        stop_words.emplace_back(stop_word_text.data + stop_word_offsets[i], stop_word_offsets[i + 1] - stop_word_offsets[i]);
+    }
+    SearchServer server(stop_words);
+    server.terms_.Load(section);
+    server.documents_ = DocumentTable::Load(section);
+    const size_t term_count = server.terms_.GetTermCount();
+    const size_t slot_count = server.documents_.GetSlotCount();
+
+    const auto document_freqs = section.ReadArray<uint32_t>();
+    const auto orphan_terms = section.ReadArray<TermId>();
+    if (document_freqs.size != term_count
+        || std::any_of(orphan_terms.begin(), orphan_terms.end(), [term_count](TermId term_id) { return term_id >= term_count; })) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    server.document_freqs_.resize(term_count);
+    server.orphan_terms_.assign(orphan_terms.begin(), orphan_terms.end());
+    server.log_document_freqs_.resize(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        server.document_freqs_.Mutable(term_id) = document_freqs[term_id];
+        server.UpdateDocumentFreq(term_id);
+    }
+    server.term_to_document_freqs_.resize(term_count);
+    server.live_postings_ = section.Read<uint64_t>();
+    server.dead_postings_ = section.Read<uint64_t>();
+    server.refresh_interval_ = section.Read<uint64_t>();
+
+    const auto forward_offsets = section.ReadArray<uint64_t>();
+    const auto forward_terms = section.ReadArray<TermId>();
+    const auto forward_term_freqs = section.ReadArray<double>();
+    if (forward_offsets.size != slot_count + 1 || forward_terms.size != forward_term_freqs.size
+        || forward_offsets[slot_count] != forward_terms.size) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    server.document_to_term_freqs_.resize(slot_count);
+    for (Slot slot = 0; slot < slot_count; ++slot) {
+        if (forward_offsets[slot] > forward_offsets[slot + 1] || forward_offsets[slot + 1] > forward_terms.size) {
+            throw std::runtime_error("Поврежден файл индекса " + path);
+        }
+        auto& document_terms = server.document_to_term_freqs_.Mutable(slot);
+        document_terms.reserve(forward_offsets[slot + 1] - forward_offsets[slot]);
+        for (size_t i = forward_offsets[slot]; i < forward_offsets[slot + 1]; ++i) {
+            if (forward_terms[i] >= term_count) {
+                throw std::runtime_error("Поврежден файл индекса " + path);
+            }
+            document_terms.emplace_back(forward_terms[i], forward_term_freqs[i]);
+        }
+        // удаленный документ с терминами еще не учтен в статистике
+        if (!server.documents_.IsAlive(slot) && !document_terms.empty()) {
+            server.removed_slots_.push_back(slot);
+        }
+    }
+    server.UpdateDocumentCount();
+
+    // сегменты идут подряд по слотам и вместе покрывают все слоты
+    const auto segment_dead_postings = section.ReadArray<uint64_t>();
+    if (segment_dead_postings.size != reader.GetSectionCount() - 1) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    Slot next_slot = 0;
+    for (size_t i = 1; i < reader.GetSectionCount(); ++i) {
+        if (reader.GetSectionKind(i) != IndexSectionKind::SEGMENT) {
+            throw std::runtime_error("Поврежден файл индекса " + path);
+        }
+        if (options.prefetch) {
+            reader.PrefetchSection(i);
+        }
+        IndexSectionReader segment_section = reader.OpenSection(i, options.verify_postings);
+        auto segment = std::make_shared<const IndexSegment>(IndexSegment::Load(segment_section, reader.GetFile(), term_count));
+        if (segment->GetFirstSlot() != next_slot || segment->GetLastSlot() > slot_count) {
+            throw std::runtime_error("Поврежден файл индекса " + path);
+        }
+        next_slot = segment->GetLastSlot();
+        server.segments_.push_back({std::move(segment), segment_dead_postings[i - 1]});
+    }
+    if (next_slot != slot_count) {
+        throw std::runtime_error("Поврежден файл индекса " + path);
+    }
+    server.mutable_first_slot_ = next_slot;
+    return server;
+}
+
+void SearchServer::CompactStorage() {
+    terms_.Compact();
+    // кэш частот хранит строки терминов
+    word_freqs_.freqs.clear();
+}
+
+size_t SearchServer::GetTermStorageBytes() const {
+    return terms_.GetArena().GetAllocatedBytes();
 }
 
 std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
     std::vector<std::string_view> words;
-    for (auto word : SplitIntoWordsStringView(text)) {
+    ForEachToken(text, [this, &words](std::string_view word, bool has_control_chars) {
+        if (has_control_chars) throw std::invalid_argument("Недопустимый формат слов");
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
+    });
     return words;
 }
 
@@ -108,67 +843,111 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::fabs(lhs.relevance - rhs.relevance) < EPSILON) {
+        // при равных релевантности и рейтинге порядок задает id: частичная сортировка неустойчива
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
     return  MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus>  SearchServer::MatchDocument(std::execution::sequenced_policy, std::string_view raw_query, int document_id) const{
-    if (!ids_.count(document_id)) {
+    const Slot slot = documents_.FindSlot(document_id);
+    if (slot == DocumentTable::NO_SLOT) {
         throw std::out_of_range("Документа с указанным id не существует.");
     }
-    const auto query = ParseQuery(raw_query);
+    const QueryArena::Scope arena_scope;
+    const auto query = ParseQuery(raw_query, arena_scope.GetResource());
     std::vector<std::string_view> matched_words;
-
-    for (const auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(std::move(word));
-        }
+    if (IsExcluded(query, slot)) {
+        return {std::move(matched_words), documents_.GetStatus(slot)};
     }
 
-    for (const auto word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return {std::move(matched_words), documents_.at(document_id).status};
+    for (const auto term_id : query.plus_terms) {
+        if (DocumentContainsTerm(slot, term_id)) {
+            matched_words.push_back(terms_.GetTerm(term_id));
         }
     }
 
-    return  {std::move(matched_words), documents_.at(document_id).status};
+    return  {std::move(matched_words), documents_.GetStatus(slot)};
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus>  SearchServer::MatchDocument(std::execution::parallel_policy, std::string_view raw_query, int document_id) const{
-    if (!ids_.count(document_id)) {
+    const Slot slot = documents_.FindSlot(document_id);
+    if (slot == DocumentTable::NO_SLOT) {
         throw std::out_of_range("Документа с указанным id не существует.");
     }
 
-    const auto& query = ParseQuery(raw_query);
+    const QueryArena::Scope arena_scope;
+    const auto query = ParseQuery(raw_query, arena_scope.GetResource());
 
-    const auto word_freqs_doc = GetWordFrequencies(document_id);
-    const auto word_count = [&word_freqs_doc](const auto word){
-        return word_freqs_doc.count(word) > 0;
+    const auto term_count = [this, slot](const TermId term_id){
+        return DocumentContainsTerm(slot, term_id);
     };
 
     std::vector<std::string_view> matched_words;
-    if (std::any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(), word_count)) {
-        return {std::move(matched_words), documents_.at(document_id).status};
+    if (std::any_of(std::execution::par, query.minus_terms.begin(), query.minus_terms.end(), term_count)) {
+        return {std::move(matched_words), documents_.GetStatus(slot)};
     }
 
-    matched_words.reserve(query.plus_words.size());
-    std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), std::back_inserter(matched_words), word_count);
+    std::pmr::vector<TermId> matched_terms(query.plus_terms.size(), arena_scope.GetResource());
+    matched_terms.erase(std::copy_if(std::execution::par, query.plus_terms.begin(), query.plus_terms.end(), matched_terms.begin(), term_count),
+                        matched_terms.end());
+    matched_words.reserve(matched_terms.size());
+    for (const auto term_id : matched_terms) {
+        matched_words.push_back(terms_.GetTerm(term_id));
+    }
 
-    return {std::move(matched_words), documents_.at(document_id).status};
+    return {std::move(matched_words), documents_.GetStatus(slot)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text) const{
-    return ParseQuery(std::execution::seq, text);
+SearchServer::Query SearchServer::ParseQuery(std::string_view text, std::pmr::memory_resource* resource) const{
+    std::pmr::vector<std::string_view> plus_words(resource);
+    std::pmr::vector<std::string_view> minus_words(resource);
+    ForEachToken(text, [this, &plus_words, &minus_words](std::string_view word, bool has_control_chars) {
+        const QueryWord query_word = ParseQueryWord(word, has_control_chars);
+        if (!query_word.is_stop) {
+            if (query_word.is_minus) {
+                minus_words.push_back(query_word.data);
+            } else {
+                plus_words.push_back(query_word.data);
+            }
+        }
+    });
+
+    std::sort(minus_words.begin(), minus_words.end());
+    minus_words.erase(std::unique(minus_words.begin(), minus_words.end()), minus_words.end());
+
+    std::sort(plus_words.begin(), plus_words.end());
+    plus_words.erase(std::unique(plus_words.begin(), plus_words.end()), plus_words.end());
+
+    // порядок плюс-слов сохраняется лексикографическим: от него зависит порядок MatchDocument
+    Query query(resource);
+    query.plus_terms.reserve(plus_words.size());
+    for (const auto word : plus_words) {
+        const TermId term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            query.plus_terms.push_back(term_id);
+        }
+    }
+    query.minus_terms.reserve(minus_words.size());
+    for (const auto word : minus_words) {
+        const TermId term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            query.minus_terms.push_back(term_id);
+        }
+    }
+    return query;
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool has_control_chars) const {
     bool is_minus = false;
     if (text[0] == '-') {
         is_minus = true;
@@ -176,12 +955,228 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
     }
     if (text.empty()) throw std::invalid_argument("Пустой поисковый запрос");
     if (text[0] == '-') throw std::invalid_argument("Более одного минуса в поисковом запросе");
-    if (!IsValidWord(text)) throw std::invalid_argument("В поисковом запросе встречаются недопустимые символы");
+    if (has_control_chars) throw std::invalid_argument("В поисковом запросе встречаются недопустимые символы");
     return {text, is_minus, IsStopWord(text)};
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    // у термина без живых документов учитываемых вхождений нет, и его IDF ни на что не влияет
+    if (document_freqs_[term_id] == 0) {
+        return 0;
+    }
+    return log_document_count_ - log_document_freqs_[term_id];
+}
+
+void SearchServer::UpdateDocumentFreq(TermId term_id) {
+    const size_t document_freq = document_freqs_[term_id];
+    log_document_freqs_.Mutable(term_id) = document_freq == 0 ? 0 : std::log(document_freq);
+}
+
+void SearchServer::RefreshIfNeeded() {
+    if (refresh_interval_ > 0 && documents_.GetSlotCount() - mutable_first_slot_ >= refresh_interval_) {
+        Refresh();
+    }
+}
+
+void SearchServer::ApplyRemovals() {
+    if (removed_slots_.empty()) {
+        return;
+    }
+    for (const Slot slot : removed_slots_) {
+        for (const auto& [term_id, _] : document_to_term_freqs_[slot]) {
+            --document_freqs_.Mutable(term_id);
+            UpdateDocumentFreq(term_id);
+        }
+        MarkPostingsDead(slot);
+        document_to_term_freqs_.Mutable(slot) = {};
+    }
+    removed_slots_.clear();
+    UpdateDocumentCount();
+    // IDF поменялся, и прежняя выдача из кэша больше не верна
+    generation_ = NextGeneration();
+}
+
+void SearchServer::UpdateDocumentCount() {
+    const size_t document_count = GetDocumentCount() + removed_slots_.size();
+    log_document_count_ = document_count == 0 ? 0 : std::log(document_count);
+}
+
+void SearchServer::MarkPostingsDead(Slot slot) {
+    const auto& document_terms = document_to_term_freqs_[slot];
+    for (const auto& [term_id, _] : document_terms) {
+        if (document_freqs_[term_id] == 0) {
+            orphan_terms_.push_back(term_id);
+        }
+    }
+    if (slot < mutable_first_slot_) {
+        const auto segment = std::upper_bound(segments_.begin(), segments_.end(), slot,
+                                              [](Slot value, const SegmentRef& ref) { return value < ref.segment->GetLastSlot(); });
+        segment->dead_postings += document_terms.size();
+    }
+    live_postings_ -= document_terms.size();
+    dead_postings_ += document_terms.size();
+}
+
+IndexSegment SearchServer::FreezeMutableSegment(size_t& dropped_postings) const {
+    IndexSegment segment(mutable_first_slot_, static_cast<Slot>(documents_.GetSlotCount()));
+    // сегмент собирается по возрастанию id терминов
+    std::vector<TermId> term_ids = mutable_terms_;
+    std::sort(term_ids.begin(), term_ids.end());
+    for (const TermId term_id : term_ids) {
+        const PostingList& postings = term_to_document_freqs_[term_id];
+        // вхождения удаленных документов в сегмент не переносятся
+        segment.BeginTerm(term_id);
+        for (size_t i = 0; i < postings.size(); ++i) {
+            const Slot slot = postings.GetSlots()[i];
+            // вхождения ждущих учета удалений остаются: счетчики мертвых их еще не включают
+            if (documents_.IsAlive(slot) || !document_to_term_freqs_[slot].empty()) {
+                segment.AddPosting(slot, postings.GetTermFreqs()[i]);
+            } else {
+                ++dropped_postings;
+            }
+        }
+        segment.EndTerm();
+    }
+    return segment;
+}
+
+void SearchServer::MergeSegments(size_t max_merged_slots) {
+    size_t merged_slots = 0;
+    while (segments_.size() >= SEGMENT_MERGE_FACTOR) {
+        // самая мелкая серия соседних сегментов одного яруса
+        auto first = segments_.end();
+        size_t first_slots = std::numeric_limits<size_t>::max();
+        for (auto begin = segments_.begin(); begin + SEGMENT_MERGE_FACTOR <= segments_.end(); ++begin) {
+            const size_t tier = GetSegmentTier(*begin->segment);
+            const auto end = begin + SEGMENT_MERGE_FACTOR;
+            if (!std::all_of(begin + 1, end, [this, tier](const SegmentRef& ref) { return GetSegmentTier(*ref.segment) == tier; })) {
+                continue;
+            }
+            const size_t slots = (end - 1)->segment->GetLastSlot() - begin->segment->GetFirstSlot();
+            if (slots < first_slots) {
+                first = begin;
+                first_slots = slots;
+            }
+        }
+        if (first == segments_.end() || first_slots > max_merged_slots - merged_slots) {
+            break;
+        }
+        const auto last = first + SEGMENT_MERGE_FACTOR;
+        std::vector<const IndexSegment*> parts;
+        for (auto ref = first; ref != last; ++ref) {
+            parts.push_back(ref->segment.get());
+            dead_postings_ -= ref->dead_postings;
+        }
+        auto merged = ShareSegment(IndexSegment::Merge(parts, [this](Slot slot) { return documents_.IsAlive(slot); }));
+        *first = {std::move(merged), 0};
+        segments_.erase(first + 1, last);
+        merged_slots += first_slots;
+    }
+}
+
+std::shared_ptr<const IndexSegment> SearchServer::ShareSegment(IndexSegment segment) const {
+    if (is_posting_compression_) {
+        segment.Compress();
+    }
+    return std::make_shared<const IndexSegment>(std::move(segment));
+}
+
+size_t SearchServer::GetSegmentTier(const IndexSegment& segment) const {
+    // ярус растет с каждым умножением числа слотов сегмента на SEGMENT_MERGE_FACTOR
+    size_t size = (segment.GetLastSlot() - segment.GetFirstSlot()) / std::max<size_t>(refresh_interval_, 1);
+    size_t tier = 0;
+    while (size >= SEGMENT_MERGE_FACTOR) {
+        size /= SEGMENT_MERGE_FACTOR;
+        ++tier;
+    }
+    return tier;
+}
+
+void SearchServer::CompactPostingsIfNeeded() {
+    if (dead_postings_ >= MIN_DEAD_POSTINGS_TO_COMPACT && 2 * dead_postings_ > live_postings_) {
+        CompactPostings();
+    }
+}
+
+SlotBitmap SearchServer::BuildExclusion(const Query& query, const SearchBudget* budget) const {
+    if (query.minus_terms.empty()) {
+        return {};
+    }
+    SlotBitmap excluded(documents_.GetSlotCount());
+    const size_t check_interval = budget == nullptr ? std::numeric_limits<size_t>::max() : BUDGET_CHECK_INTERVAL;
+    bool is_stopped = false;
+    for (const TermId term_id : query.minus_terms) {
+        const QueryArena::Scope arena_scope;
+        ForEachPostingSpan(term_id, 0, DocumentTable::NO_SLOT, [&](const PostingSpan& postings) {
+            for (size_t i = 0; i < postings.size() && !is_stopped;) {
+                const size_t chunk_end = postings.size() - i > check_interval ? i + check_interval : postings.size();
+                for (; i < chunk_end; ++i) {
+                    excluded.Set(postings.GetSlots()[i]);
+                }
+                is_stopped = budget != nullptr && budget->IsExhausted();
+            }
+        });
+        if (is_stopped) {
+            break;
+        }
+    }
+    return excluded;
+}
+
+bool SearchServer::UsesSlotBitmaps(const Query& query) const {
+    size_t posting_count = 0;
+    for (const TermId term_id : query.plus_terms) {
+        posting_count += document_freqs_[term_id];
+    }
+    return posting_count * SLOTS_PER_POSTING_FOR_BITMAPS >= documents_.GetSlotCount();
+}
+
+QueryResultCache::Key SearchServer::MakeCacheKey(const Query& query, const DocumentFilter& filter, const SearchOptions& options) {
+    QueryResultCache::Key key;
+    key.reserve(query.plus_terms.size() + query.minus_terms.size() + 2 * filter.id_ranges.size() + 9);
+    // плюс-слова упорядочены лексикографически, минус-слова - в порядке слов; оба списка без повторов
+    std::vector<TermId> plus_terms(query.plus_terms.begin(), query.plus_terms.end());
+    std::sort(plus_terms.begin(), plus_terms.end());
+    key.push_back(static_cast<uint32_t>(plus_terms.size()));
+    key.insert(key.end(), plus_terms.begin(), plus_terms.end());
+    std::vector<TermId> minus_terms(query.minus_terms.begin(), query.minus_terms.end());
+    std::sort(minus_terms.begin(), minus_terms.end());
+    key.push_back(static_cast<uint32_t>(minus_terms.size()));
+    key.insert(key.end(), minus_terms.begin(), minus_terms.end());
+
+    // пустой список статусов допускает любой статус
+    uint32_t status_mask = filter.statuses.empty() ? (1u << DocumentTable::STATUS_COUNT) - 1 : 0;
+    for (const DocumentStatus status : filter.statuses) {
+        status_mask |= 1u << static_cast<int>(status);
+    }
+    key.push_back(status_mask);
+    key.push_back(static_cast<uint32_t>(filter.min_rating));
+    key.push_back(static_cast<uint32_t>(filter.max_rating));
+    std::vector<std::pair<int, int>> id_ranges = filter.id_ranges;
+    std::sort(id_ranges.begin(), id_ranges.end());
+    id_ranges.erase(std::unique(id_ranges.begin(), id_ranges.end()), id_ranges.end());
+    key.push_back(static_cast<uint32_t>(id_ranges.size()));
+    for (const auto& [first, last] : id_ranges) {
+        key.push_back(static_cast<uint32_t>(first));
+        key.push_back(static_cast<uint32_t>(last));
+    }
+    // способ обхода в ключ не входит: выдача от него не зависит
+    const size_t max_window = std::numeric_limits<uint32_t>::max();
+    key.push_back(static_cast<uint32_t>(std::min(options.top_k, max_window)));
+    key.push_back(static_cast<uint32_t>(std::min(options.offset, max_window)));
+    return key;
+}
+
+bool SearchServer::IsExcluded(const Query& query, Slot slot) const {
+    return std::any_of(query.minus_terms.begin(), query.minus_terms.end(),
+                       [this, slot](TermId term_id) { return DocumentContainsTerm(slot, term_id); });
+}
+
+bool SearchServer::DocumentContainsTerm(Slot slot, TermId term_id) const {
+    const auto& document_terms = document_to_term_freqs_[slot];
+    const auto itr = std::lower_bound(document_terms.begin(), document_terms.end(), term_id,
+                                      [](const auto& term_freq, TermId id) { return term_freq.first < id; });
+    return itr != document_terms.end() && itr->first == term_id;
 }
 
 bool SearchServer::IsValidWord(std::string_view word) {
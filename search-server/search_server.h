@@ -5,19 +5,105 @@
 #include <unordered_set>
 #include <map>
 #include <cmath>
+#include <limits>
 #include <iterator>
 #include <algorithm>
 #include <execution>
+#include <numeric>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <memory>
 
 #include "document.h"
 #include "string_processing.h"
 #include <string_view>
-#include <deque>
-#include "concurrent_map.h"
+#include <memory_resource>
+#include <mutex>
+#include <condition_variable>
 #include "log_duration.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "index_segment.h"
+#include "document_table.h"
+#include "shared_chunk_vector.h"
+#include "slot_bitmap.h"
+#include "query_result_cache.h"
+#include "query_arena.h"
+#include "search_budget.h"
+#include "relevance_accumulator.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double EPSILON = 1e-6;
+// меньшие диапазоны слотов не окупают запуск отдельной задачи в параллельном поиске
+const size_t MIN_SLOTS_PER_PARTITION = 4096;
+// битовые карты фильтра и минус-слов строятся за время, пропорциональное числу слотов; они окупаются,
+// когда у плюс-слов запроса набирается хотя бы одно вхождение на столько слотов
+const size_t SLOTS_PER_POSTING_FOR_BITMAPS = 64;
+// FindTopDocumentsBatch обходит списки вхождений один раз на блок из стольких запросов
+// и диапазон из стольких слотов: накопитель такой плитки помещается в кэш
+const size_t BATCH_QUERY_BLOCK = 256;
+const size_t BATCH_TILE_SLOTS = 256;
+// если в блоках пакета на термин в среднем приходится меньше запросов, общий обход
+// не окупает плиток, и запросы пакета выполняются по одному
+const size_t BATCH_MIN_QUERIES_PER_TERM = 2;
+// MAX_SCORE копит вклады значимых слов в окне из стольких слотов, а затем проверяет
+// найденные в нем документы по незначимым словам
+const size_t MAX_SCORE_WINDOW_SLOTS = 1024;
+// удаленные документы остаются в списках вхождений, пока их не станет больше этого числа
+// и половины живых вхождений
+const size_t MIN_DEAD_POSTINGS_TO_COMPACT = 4096;
+// меньшие диапазоны пакета не окупают отдельную задачу при пакетном добавлении
+const size_t MIN_DOCUMENTS_PER_CHUNK = 256;
+// изменяемый сегмент по умолчанию замораживается, когда в нем набирается столько документов
+const size_t REFRESH_DOCUMENT_COUNT = 4096;
+// столько сегментов одного яруса сливаются в один сегмент следующего
+const size_t SEGMENT_MERGE_FACTOR = 4;
+// слияния при заморозке переписывают не больше стольких интервалов заморозки слотов,
+// а более крупные слияния ждут Maintain
+const size_t MERGE_REFRESH_INTERVALS_PER_REFRESH = 64;
+
+// EXHAUSTIVE оценивает все вхождения плюс-слов по очереди терминов,
+// MAX_SCORE идет по документам и пропускает те документы и блоки вхождений,
+// что не могут попасть в выдачу. Обход MAX_SCORE последовательный: политика
+// выполнения на него не влияет
+enum class EvaluationMode {
+    EXHAUSTIVE,
+    MAX_SCORE,
+};
+
+// счетчики обхода запроса
+struct SearchStats {
+    // вхождения, вклад которых добавлен к релевантности документа
+    size_t scored_postings = 0;
+};
+
+// окно выдачи: сколько документов вернуть и сколько лучших пропустить перед ними
+struct SearchOptions {
+    size_t top_k = MAX_RESULT_DOCUMENT_COUNT;
+    size_t offset = 0;
+    EvaluationMode mode = EvaluationMode::EXHAUSTIVE;
+    // если задан, к нему прибавляются счетчики обхода. Выдача из кэша и FindTopDocumentsBatch их не меняют
+    SearchStats* stats = nullptr;
+};
+
+// как открывать сохраненный индекс
+struct LoadOptions {
+    // сверять контрольные суммы сегментов, читая их с диска целиком; без этого TF сегментов
+    // подкачиваются лениво, при первом обращении запроса. Смещения, id терминов и слоты сегментов
+    // проверяются всегда, и служебная секция со словарем и таблицей документов сверяется всегда
+    bool verify_postings = false;
+    // заранее попросить ядро подкачать страницы сегментов
+    bool prefetch = false;
+};
+
+// документ для пакетного добавления; текст должен жить до конца вызова AddDocuments
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
 
 class SearchServer {
 public:
@@ -33,6 +119,9 @@ public:
     explicit SearchServer(const std::string_view stop_words_text): SearchServer(SplitIntoWordsStringView(stop_words_text)) {}
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // разбирает документы параллельно и добавляет их за один шаг. Проверки те же, что
+    // у AddDocument; при ошибке в любом документе сервер не меняется
+    void AddDocuments(const std::vector<NewDocument>& documents);
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
     template <typename ExecutionPolicy>
@@ -43,11 +132,43 @@ public:
     template <typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
 
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const;
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+    // фильтр вычисляется в битовую карту слотов один раз на запрос вместо вызова предиката на каждое вхождение
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options) const;
+    // пакет запросов: запросы группируются по терминам, и список вхождений каждого термина
+    // обходится один раз для всех запросов. Выдача каждого запроса совпадает с FindTopDocuments
+    // с теми же статусом и окном; options.mode не учитывается. Пакет запросов, мало пересекающихся
+    // по терминам (см. BATCH_MIN_QUERIES_PER_TERM), выполняется по запросам
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             const SearchOptions& options = {}) const;
+    // поиск с бюджетом: обход вхождений раз в BUDGET_CHECK_INTERVAL вхождений или документов сверяется
+    // со сроком и отменой. По истечении срока возвращает лучшие документы по обойденной части,
+    // помеченные неполными, а при ExpiryAction::CANCEL бросает system_error с кодом timed_out.
+    // Прерванный отменой поиск бросает system_error с кодом operation_canceled.
+    // Неполная выдача в кэш не попадает
+    BudgetedResult FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options, const SearchBudget& budget) const;
+    // то же в общем пуле SearchExecutor с постоянным числом потоков. Деструктор сервера дожидается
+    // начатых так поисков; менять и перемещать сервер, пока они идут, нельзя
+    std::future<BudgetedResult> FindTopDocumentsAsync(std::string raw_query, DocumentStatus status, const SearchOptions& options,
+                                                      std::shared_ptr<SearchBudget> budget) const;
+
     int GetDocumentCount() const;
     int GetDocumentId(int index) const;
 
-    std::set<int>::const_iterator begin();
-    std::set<int>::const_iterator end();
+    std::vector<int>::const_iterator begin();
+    std::vector<int>::const_iterator end();
 
     using MatchedDocument = std::tuple<std::vector<std::string_view>, DocumentStatus>;
     MatchedDocument MatchDocument(std::string_view raw_query, int document_id) const;
@@ -60,143 +181,766 @@ public:
     void RemoveDocument(std::execution::sequenced_policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy, int document_id);
 
+    // кэширует выдачу запросов со статусом или DocumentFilter; запросы с предикатом не кэшируются.
+    // Копии сервера делят кэш, а включение и выключение заменяют его только у этого сервера.
+    // Включать и выключать кэш можно только когда к серверу нет параллельных обращений
+    void EnableResultCache(size_t max_bytes, size_t shard_count = 16);
+    void DisableResultCache();
+    QueryResultCache::Stats GetResultCacheStats() const;
+
+    // переносит строки терминов из полупустых кусков хранилища и освобождает память.
+    // Вызывается и из Maintain, но не из изменений сервера; строки из MatchDocument
+    // и GetWordFrequencies действительны до следующего изменения сервера
+    void CompactStorage();
+    // удаление за O(1) лишь помечает документ: запросы его сразу не видят, но до учета удаления
+    // его термины остаются в df и N, по которым считается IDF. Удаления учитываются пачкой
+    // в Maintain, Refresh и CompactPostings. Уплотнение вычищает вхождения удаленных документов
+    // и освобождает термины без документов
+    void CompactPostings();
+    size_t GetDeadPostingCount() const;
+    // шаг обслуживания вне пути запросов и изменений: учитывает удаления, доделывает отложенные
+    // слияния сегментов, уплотняет списки, когда удаленных вхождений набралось достаточно,
+    // и хранилище строк, когда оно полупусто
+    void Maintain();
+    size_t GetPendingRemovalCount() const;
+
+    // индекс состоит из неизменяемых плоских сегментов и небольшого изменяемого, куда пишут
+    // AddDocument и AddDocuments. Документы изменяемого сегмента тоже видны запросам.
+    // Refresh замораживает изменяемый сегмент и сливает сегменты одного яруса в пределах
+    // MERGE_REFRESH_INTERVALS_PER_REFRESH интервалов заморозки; остальные слияния делает Maintain
+    void Refresh();
+    // 0 отключает автоматическое замораживание
+    void SetRefreshInterval(size_t document_count);
+    size_t GetSegmentCount() const;
+    // сжатые сегменты занимают в несколько раз меньше памяти, а запросы распаковывают их списки
+    // в арену потока. Настройка переписывает имеющиеся сегменты и действует на новые; в файл не сохраняется
+    void SetPostingCompression(bool is_compressed);
+    // память, занятая слотами и TF вхождений замороженных сегментов
+    size_t GetPostingStorageBytes() const;
+
+    // записывает индекс в двоичный файл (формат описан в index_file.h): стоп-слова, словарь,
+    // таблицу документов, прямой индекс и сегменты, включая замороженную копию изменяемого
+    void Save(const std::string& path) const;
+    // открывает файл через mmap: списки вхождений сегментов читаются из файла без копирования,
+    // а словарь, таблица документов и прямой индекс разбираются в память за время,
+    // пропорциональное их размеру; смещения и слоты сегментов проверяются за один проход.
+    // Бросает runtime_error для чужого или поврежденного файла
+    static SearchServer Load(const std::string& path, const LoadOptions& options = {});
+    // память, занятая строками терминов
+    size_t GetTermStorageBytes() const;
+
 private:
-    //хранит все слова в виде строк (т.е. не удаляет их никогда)
-    std::deque<std::string> storage_;
+    using TermId = TermDictionary::TermId;
+    using Slot = DocumentTable::Slot;
+
     const std::set<std::string, std::less<>> stop_words_;
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
+    // позиция в списках вхождений одного плюс-слова при обходе по документам. Непустые списки
+    // сегментов [span, spans_end) идут подряд по слотам, и курсор проходит их как один список
+    struct TermCursor {
+        const PostingSpan* span;
+        const PostingSpan* spans_end;
+        size_t position;
+        double inverse_document_freq;
+        // наибольший вклад термина в релевантность по всем его спискам
+        double upper_bound;
+
+        bool IsExhausted() const {
+            return span == spans_end;
+        }
+        Slot GetSlot() const {
+            return IsExhausted() ? DocumentTable::NO_SLOT : span->GetSlots()[position];
+        }
+        double GetContribution() const {
+            return span->GetTermFreqs()[position] * inverse_document_freq;
+        }
+        double GetBlockBound() const {
+            return span->GetBlockMaxTermFreq(position) * inverse_document_freq;
+        }
+        Slot GetBlockLastSlot() const {
+            return span->GetBlockLastSlot(position);
+        }
+        // position не дальше конца текущего списка
+        void MoveTo(size_t new_position) {
+            position = new_position;
+            if (position == span->size()) {
+                ++span;
+                position = 0;
+            }
+        }
+        // наибольший вклад термина в документы со слотами от текущего до last по максимумам блоков
+        double GetBound(Slot last) const {
+            float max_term_freq = 0;
+            const PostingSpan* block_span = span;
+            size_t block_position = position;
+            while (block_span != spans_end && block_span->GetSlots()[block_position] < last) {
+                max_term_freq = std::max(max_term_freq, block_span->GetBlockMaxTermFreq(block_position));
+                block_position = (block_position / PostingSpan::BLOCK_SIZE + 1) * PostingSpan::BLOCK_SIZE;
+                if (block_position >= block_span->size()) {
+                    ++block_span;
+                    block_position = 0;
+                }
+            }
+            return max_term_freq * inverse_document_freq;
+        }
+        // переходит к первому вхождению со слотом не меньше slot
+        void Seek(Slot slot) {
+            while (span != spans_end && span->GetSlots()[span->size() - 1] < slot) {
+                ++span;
+                position = 0;
+            }
+            if (span != spans_end) {
+                position = span->Seek(position, slot);
+            }
+        }
+    };
+    // слова запроса, отсутствующие в словаре, отбрасываются: они не могут ничего найти
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        explicit Query(std::pmr::memory_resource* resource)
+            : plus_terms(resource), minus_terms(resource) {
+        }
+        std::pmr::vector<TermId> plus_terms;
+        std::pmr::vector<TermId> minus_terms;
     };
 
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
-    mutable std::map<int, std::map<std::string_view, double>> word_freqs_;
-    std::set<int> ids_;
+    TermDictionary terms_;
+    // замороженный сегмент общий для копий сервера (снимков), а счетчик вхождений
+    // удаленных документов у каждой копии свой; они вычищаются при пересборке сегмента
+    struct SegmentRef {
+        std::shared_ptr<const IndexSegment> segment;
+        size_t dead_postings = 0;
+    };
+    // неизменяемые сегменты по возрастанию слотов, вместе покрывают [0, mutable_first_slot_)
+    std::vector<SegmentRef> segments_;
+    // изменяемый сегмент: term_id -> вхождения документов со слотами от mutable_first_slot_
+    SharedChunkVector<PostingList> term_to_document_freqs_;
+    // термины с непустыми списками изменяемого сегмента, без повторов: заморозка
+    // и уплотнение обходят только их, а не весь словарь
+    std::vector<TermId> mutable_terms_;
+    Slot mutable_first_slot_ = 0;
+    size_t refresh_interval_ = REFRESH_DOCUMENT_COUNT;
+    bool is_posting_compression_ = false;
+    // термины, число документов которых падало до нуля; освобождаются при уплотнении
+    std::vector<TermId> orphan_terms_;
+    // IDF = log(N) - log(df): при изменении N таблица log(df) остается верной,
+    // а при добавлении и удалении документа обновляются только его термины
+    SharedChunkVector<double> log_document_freqs_;
+    // число документов с термином, включая удаленные из removed_slots_; списки вхождений
+    // могут содержать и удаленные
+    SharedChunkVector<uint32_t> document_freqs_;
+    // удаленные документы, чьи термины еще учитываются в df и прямом индексе
+    std::vector<Slot> removed_slots_;
+    size_t live_postings_ = 0;
+    size_t dead_postings_ = 0;
+    double log_document_count_ = 0;
+    DocumentTable documents_;
+    // прямой индекс: слот документа -> (term_id, TF), упорядочен по term_id
+    SharedChunkVector<std::vector<std::pair<TermId, double>>> document_to_term_freqs_;
+    // строковое представление частот для GetWordFrequencies, строится по первому запросу
+    struct WordFreqsCache {
+        WordFreqsCache() = default;
+        // строки в кэше указывают в словарь исходного сервера, поэтому копия строит свой
+        WordFreqsCache(const WordFreqsCache&) {
+        }
+        std::mutex mtx;
+        std::map<int, std::map<std::string_view, double>> freqs;
+    };
+    mutable WordFreqsCache word_freqs_;
+    // меняется на новое при каждом изменении индекса и делает устаревшими записи кэша выдачи
+    uint64_t generation_ = 0;
+    // копии сервера, в том числе снимки SnapshotSearchServer, делят кэш: записи помечены
+    // поколением, поэтому копия видит только записи от индекса, совпадающего с ее собственным
+    std::shared_ptr<QueryResultCache> result_cache_ = std::make_shared<QueryResultCache>();
+    // число незавершенных асинхронных поисков. Объявлено последним, чтобы деструктор дождался их,
+    // пока остальные поля еще живы
+    struct PendingSearches {
+        PendingSearches() = default;
+        // у копии своих поисков нет
+        PendingSearches(const PendingSearches&) {
+        }
+        PendingSearches& operator=(const PendingSearches&) {
+            return *this;
+        }
+        ~PendingSearches();
+        std::mutex mtx;
+        std::condition_variable finished;
+        size_t count = 0;
+    };
+    mutable PendingSearches pending_searches_;
 
+    // бросает invalid_argument, если в тексте есть управляющие символы
     std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // инвертированный индекс одного диапазона пакета AddDocuments с локальными номерами терминов
+    struct PartialIndex {
+        std::unordered_map<std::string_view, uint32_t> local_ids;
+        std::vector<std::string_view> words;
+        // вхождения локального термина: (номер документа в пакете, TF) по возрастанию номера
+        std::vector<std::vector<std::pair<size_t, double>>> postings;
+        // термины документов диапазона: (локальный номер, TF)
+        std::vector<std::vector<std::pair<uint32_t, double>>> document_terms;
+        std::vector<TermId> global_ids;
+        std::exception_ptr error;
+    };
+    void BuildPartialIndex(const std::vector<NewDocument>& documents, size_t first, size_t last, PartialIndex& index) const;
 
-    Query ParseQuery(std::string_view text) const;
-    template <typename ExecutionPolicy>
-    Query ParseQuery(const ExecutionPolicy& policy, std::string_view text) const;
+    // has_control_chars вычисляется токенизатором вместе с границами слова
+    QueryWord ParseQueryWord(std::string_view text, bool has_control_chars) const;
 
-    static int ComputeAverageRating(const std::vector<int>& ratings);
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    // временные массивы и сам запрос размещаются в resource, обычно в арене потока
+    Query ParseQuery(std::string_view text, std::pmr::memory_resource* resource) const;
 
-    template <typename DocumentPredicate, typename ExecutionPolicy>
-    std::vector<Document> FindAllDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate) const;
+    static int ComputeAverageRating(const std::vector<int>& ratings);
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+    // оставляет в documents окно options, упорядоченное по убыванию релевантности;
+    // частичная сортировка обходится в O(N log(offset + top_k)) вместо O(N log N)
+    template <typename ExecutionPolicy>
+    static void SelectTopDocuments(const ExecutionPolicy& policy, std::vector<Document>& documents, const SearchOptions& options);
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+    void UpdateDocumentFreq(TermId term_id);
+    // уплотняет списки вхождений, когда удаленных вхождений набралось достаточно
+    void CompactPostingsIfNeeded();
+    void RefreshIfNeeded();
+    // переносит удаления из removed_slots_ в df, счетчики вхождений и прямой индекс
+    void ApplyRemovals();
+    // N в IDF включает удаленные документы, пока удаления не учтены
+    void UpdateDocumentCount();
+    // учитывает удаленный документ в счетчиках терминов и сегмента
+    void MarkPostingsDead(Slot slot);
+    // плоская копия изменяемого сегмента без вхождений удаленных документов
+    IndexSegment FreezeMutableSegment(size_t& dropped_postings) const;
+    // сливает соседние сегменты, пока их набирается SEGMENT_MERGE_FACTOR на одном ярусе,
+    // начиная с самых мелких и переписывая всего не больше max_merged_slots слотов
+    void MergeSegments(size_t max_merged_slots);
+    size_t GetSegmentTier(const IndexSegment& segment) const;
+    // сжимает новый сегмент, если включено сжатие
+    std::shared_ptr<const IndexSegment> ShareSegment(IndexSegment segment) const;
+    // вызывает callback для списков термина в сегментах, пересекающих слоты [first, last), по возрастанию слотов.
+    // Списки сжатых сегментов распаковываются в арену потока и живут до конца текущей области QueryArena::Scope
+    template <typename Callback>
+    void ForEachPostingSpan(TermId term_id, Slot first, Slot last, Callback callback) const;
+    bool DocumentContainsTerm(Slot slot, TermId term_id) const;
+    // слоты документов с минус-словами запроса; строится до оценки, чтобы они не попадали в накопители.
+    // Без минус-слов битовая карта пуста. Исчерпав budget, построение останавливается, и карта остается неполной
+    SlotBitmap BuildExclusion(const Query& query, const SearchBudget* budget = nullptr) const;
+    // выгоднее ли построить битовые карты фильтра и минус-слов, чем проверять найденные документы по одному
+    bool UsesSlotBitmaps(const Query& query) const;
+    // ключ не зависит от порядка и повторов слов запроса и от порядка статусов и диапазонов фильтра
+    static QueryResultCache::Key MakeCacheKey(const Query& query, const DocumentFilter& filter, const SearchOptions& options);
+    // та же проверка для одного документа: поиск по его прямому индексу дешевле битовой карты
+    bool IsExcluded(const Query& query, Slot slot) const;
+
+    // поиск по фильтру через кэш выдач; budget может быть nullptr
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options,
+                                           const SearchBudget* budget) const;
+    // поиск разобранного запроса по фильтру без кэша: фильтр и минус-слова проверяются по битовым картам
+    // или, для запросов из редких слов, по одному документу
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindFilteredDocuments(const ExecutionPolicy& policy, const Query& query, const DocumentFilter& filter,
+                                                const SearchOptions& options, const SearchBudget* budget) const;
+    // выбирает способ обхода и окно выдачи; slot_predicate(slot) решает, допустим ли документ,
+    // с учетом минус-слов. Исчерпав budget, обход останавливается, и выдача строится по уже найденному
+    template <typename ExecutionPolicy, typename SlotPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const Query& query, SlotPredicate slot_predicate, const SearchOptions& options,
+                                           const SearchBudget* budget = nullptr) const;
+
+    // stats может быть nullptr. Прерванный бюджетом диапазон отдает не больше partial_capacity лучших документов
+    template <typename SlotPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindAllDocuments(const ExecutionPolicy& policy, const Query& query, SlotPredicate slot_predicate,
+                                           const SearchBudget* budget = nullptr, SearchStats* stats = nullptr,
+                                           size_t partial_capacity = std::numeric_limits<size_t>::max()) const;
+    // оценивает документы со слотами из [first, last) в накопителе потока: плотном или, для редких слов, разреженном;
+    // у прерванного обхода релевантность найденных документов учитывает только обойденные вхождения.
+    // Предикат проверяется на каждом вхождении, и не прошедшие его документы в накопитель не попадают.
+    // Возвращает число добавленных в накопитель вхождений
+    template <typename SlotPredicate>
+    size_t FindDocumentsInRange(const Query& query, SlotPredicate& slot_predicate, Slot first, Slot last,
+                                std::vector<Document>& matched_documents, const SearchBudget* budget, size_t partial_capacity) const;
+
+    // обход по документам с отсечением MaxScore и пропуском блоков по их максимумам;
+    // выдача совпадает с полным перебором, а прерванная - с перебором документов до места остановки
+    template <typename SlotPredicate>
+    std::vector<Document> FindTopDocumentsMaxScore(const Query& query, SlotPredicate slot_predicate, const SearchOptions& options,
+                                                   const SearchBudget* budget = nullptr) const;
 
     static bool IsValidWord(std::string_view word);
     bool IsStopWord(std::string_view word) const;
 };
 
 template <typename ExecutionPolicy>
-SearchServer::Query SearchServer::ParseQuery(const ExecutionPolicy& policy, std::string_view text) const{
-    Query query = {};
-    for (const auto& word : SplitIntoWordsStringView(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
-            } else {
-                query.plus_words.push_back(query_word.data);
-            }
-        }
-    }
-
-    std::sort(policy, query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(std::unique(policy, query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
-
-    std::sort(policy, query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(std::unique(policy, query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const{
+    return FindTopDocuments(policy, raw_query, status, SearchOptions{});
+}
 
-    return query;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const{
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const{
+    return FindTopDocuments(policy, raw_query, document_predicate, SearchOptions{});
+}
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const{
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus statusp, int rating) { return statusp == status; });
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const{
+    DocumentFilter filter;
+    filter.statuses.push_back(status);
+    return FindTopDocuments(policy, raw_query, filter, options);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const{
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const{
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, options);
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const{
-    const auto query = ParseQuery(raw_query);
-    std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const{
+    const QueryArena::Scope arena_scope;
+    const auto query = ParseQuery(raw_query, arena_scope.GetResource());
+    const SlotBitmap excluded = UsesSlotBitmaps(query) ? BuildExclusion(query) : SlotBitmap{};
+    return FindTopDocuments(policy, query, [this, &query, &excluded, &document_predicate](Slot slot) {
+        return documents_.IsAlive(slot) && (excluded.empty() ? !IsExcluded(query, slot) : !excluded.Test(slot))
+               && document_predicate(documents_.GetId(slot), documents_.GetStatus(slot), documents_.GetRating(slot));
+    }, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const{
+    return FindTopDocuments(policy, raw_query, filter, SearchOptions{});
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options) const{
+    return FindTopDocuments(policy, raw_query, filter, options, nullptr);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter, const SearchOptions& options,
+                                                     const SearchBudget* budget) const{
+    const QueryArena::Scope arena_scope;
+    const auto query = ParseQuery(raw_query, arena_scope.GetResource());
+    // бюджет сверяется и на границах этапов: разбор, отбор по фильтру и минус-словам, обход
+    const auto is_exhausted = [budget]() { return budget != nullptr && budget->IsExhausted(); };
+    QueryResultCache::Key cache_key;
+    std::vector<Document> result;
+    if (is_exhausted()) {
+        return result;
+    }
+    if (result_cache_->IsEnabled()) {
+        cache_key = MakeCacheKey(query, filter, options);
+        if (result_cache_->Find(cache_key, generation_, result)) {
+            return result;
+        }
+    }
+    result = FindFilteredDocuments(policy, query, filter, options, budget);
+    if (result_cache_->IsEnabled() && (budget == nullptr || !budget->IsInterrupted())) {
+        result_cache_->Insert(cache_key, generation_, result);
+    }
+    return result;
+}
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs) {
-                  if (std::fabs(lhs.relevance - rhs.relevance) < EPSILON) {
-                      return lhs.rating > rhs.rating;
-                  } else {
-                      return lhs.relevance > rhs.relevance;
-                  }
-              });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindFilteredDocuments(const ExecutionPolicy& policy, const Query& query, const DocumentFilter& filter,
+                                                          const SearchOptions& options, const SearchBudget* budget) const{
+    const auto is_exhausted = [budget]() { return budget != nullptr && budget->IsExhausted(); };
+    if (!UsesSlotBitmaps(query)) {
+        return FindTopDocuments(policy, query, [this, &query, &filter](Slot slot) {
+            return documents_.Matches(slot, filter) && !IsExcluded(query, slot);
+        }, options, budget);
+    }
+    SlotBitmap candidates = documents_.Select(filter, budget);
+    if (is_exhausted()) {
+        return {};
+    }
+    const SlotBitmap excluded = BuildExclusion(query, budget);
+    if (is_exhausted()) {
+        return {};
+    }
+    if (!excluded.empty()) {
+        candidates.AndNot(excluded);
     }
+    return FindTopDocuments(policy, query, [&candidates](Slot slot) { return candidates.Test(slot); }, options, budget);
+}
 
+template <typename ExecutionPolicy, typename SlotPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const Query& query, SlotPredicate slot_predicate, const SearchOptions& options,
+                                                     const SearchBudget* budget) const{
+    if (options.mode == EvaluationMode::MAX_SCORE) {
+        return FindTopDocumentsMaxScore(query, slot_predicate, options, budget);
+    }
+    const size_t capacity = options.offset + std::min(options.top_k, std::numeric_limits<size_t>::max() - options.offset);
+    std::vector<Document> matched_documents = FindAllDocuments(policy, query, slot_predicate, budget, options.stats, capacity);
+    // отброшенную выдачу не упорядочивают, а неполная невелика: в ней только документы обойденных вхождений
+    if (budget != nullptr && budget->IsInterrupted() && !budget->KeepsPartialResult()) {
+        return {};
+    }
+    SelectTopDocuments(policy, matched_documents, options);
     return matched_documents;
 }
 
+template <typename ExecutionPolicy>
+void SearchServer::SelectTopDocuments(const ExecutionPolicy& policy, std::vector<Document>& documents, const SearchOptions& options) {
+    if (options.offset >= documents.size()) {
+        documents.clear();
+        return;
+    }
+    const size_t window_end = options.offset + std::min(options.top_k, documents.size() - options.offset);
+    std::partial_sort(policy, documents.begin(), documents.begin() + window_end, documents.end(), IsMoreRelevant);
+    documents.erase(documents.begin() + window_end, documents.end());
+    documents.erase(documents.begin(), documents.begin() + options.offset);
+}
+
 /* FIND ALL DOCUMENTS*/
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
-}
-
-template <typename DocumentPredicate, typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate) const{
-    ConcurrentMap<int, double> document_to_relevance(128);
-
-    auto plus_words_proc = [this, &document_to_relevance, &document_predicate](std::string_view word){
-        const auto itr = word_to_document_freqs_.find(word);
-        if (itr != word_to_document_freqs_.cend()){
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : itr->second){
-                const auto& [rating, status] = documents_.at(document_id);
-                if (document_predicate(document_id, status, rating)){
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+template <typename SlotPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query, SlotPredicate slot_predicate,
+                                                     const SearchBudget* budget, SearchStats* stats, size_t partial_capacity) const{
+    // слоты делятся на непересекающиеся диапазоны, у каждого свой накопитель:
+    // потокам не нужны ни блокировки, ни слияние накопителей
+    const size_t slot_count = documents_.GetSlotCount();
+    size_t partition_count = 1;
+    if constexpr (!std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        partition_count = std::clamp<size_t>(slot_count / MIN_SLOTS_PER_PARTITION, 1, thread_count * 4);
+    }
+
+    std::vector<std::vector<Document>> partition_documents(partition_count);
+    std::vector<size_t> partition_scored_postings(partition_count);
+    std::vector<size_t> partitions(partition_count);
+    std::iota(partitions.begin(), partitions.end(), 0);
+    std::for_each(policy, partitions.begin(), partitions.end(),
+                  [this, &query, &slot_predicate, &partition_documents, &partition_scored_postings, slot_count, partition_count, budget,
+                   partial_capacity](size_t partition){
+                      const Slot first = static_cast<Slot>(slot_count * partition / partition_count);
+                      const Slot last = static_cast<Slot>(slot_count * (partition + 1) / partition_count);
+                      partition_scored_postings[partition] = FindDocumentsInRange(query, slot_predicate, first, last, partition_documents[partition], budget,
+                                                                                           partial_capacity);
+                  });
+    if (stats != nullptr) {
+        stats->scored_postings += std::accumulate(partition_scored_postings.begin(), partition_scored_postings.end(), size_t{0});
+    }
+
+    if (partition_count == 1) {
+        return std::move(partition_documents.front());
+    }
+    size_t total_count = 0;
+    for (const auto& documents : partition_documents) {
+        total_count += documents.size();
+    }
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(total_count);
+    for (const auto& documents : partition_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    return matched_documents;
+}
+
+template <typename SlotPredicate>
+size_t SearchServer::FindDocumentsInRange(const Query& query, SlotPredicate& slot_predicate, Slot first, Slot last,
+                                        std::vector<Document>& matched_documents, const SearchBudget* budget, size_t partial_capacity) const{
+    // части списков внутри диапазона находятся заранее: по их длине выбирается способ накопления
+    struct RangePostings {
+        PostingSpan postings;
+        size_t begin;
+        size_t end;
+        double inverse_document_freq;
+    };
+    const QueryArena::Scope arena_scope;
+    std::pmr::vector<RangePostings> ranges(arena_scope.GetResource());
+    size_t posting_count = 0;
+    for (const TermId term_id : query.plus_terms) {
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(term_id);
+        ForEachPostingSpan(term_id, first, last, [&](const PostingSpan& postings) {
+            const size_t begin = postings.Seek(0, first);
+            const size_t end = postings.Seek(begin, last);
+            if (begin < end) {
+                ranges.push_back({postings, begin, end, inverse_document_freq});
+                posting_count += end - begin;
+            }
+        });
+    }
+
+    const RelevanceAccumulator::Lease accumulator;
+    accumulator->Begin(last - first, posting_count);
+    // без бюджета вхождения идут одним куском, с бюджетом - кусками по BUDGET_CHECK_INTERVAL с проверкой после каждого
+    const size_t check_interval = budget == nullptr ? std::numeric_limits<size_t>::max() : BUDGET_CHECK_INTERVAL;
+    bool is_stopped = false;
+    size_t scored_postings = 0;
+    for (const RangePostings& range : ranges) {
+        const uint32_t* const slots = range.postings.GetSlots();
+        const float* const term_freqs = range.postings.GetTermFreqs();
+        for (size_t i = range.begin; i < range.end && !is_stopped;) {
+            const size_t chunk_end = range.end - i > check_interval ? i + check_interval : range.end;
+            for (; i < chunk_end; ++i) {
+                // удаленные, исключенные минус-словами и не прошедшие фильтр документы в накопитель не попадают
+                if (slot_predicate(slots[i])) {
+                    accumulator->Add(slots[i] - first, term_freqs[i] * range.inverse_document_freq);
+                    ++scored_postings;
                 }
             }
+            is_stopped = budget != nullptr && budget->IsExhausted();
         }
-    };
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), plus_words_proc);
+        if (is_stopped) {
+            break;
+        }
+    }
+
+    if (is_stopped) {
+        if (!budget->KeepsPartialResult() || partial_capacity == 0) {
+            return scored_postings;
+        }
+        // неполной выдаче хватит лучших partial_capacity документов диапазона: куча отбирает их,
+        // не собирая и не упорядочивая все найденные документы
+        accumulator->Finish([&](uint32_t offset, double relevance) {
+            const Slot slot = first + offset;
+            const Document document(documents_.GetId(slot), relevance, documents_.GetRating(slot));
+            if (matched_documents.size() < partial_capacity) {
+                matched_documents.push_back(document);
+                std::push_heap(matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+            } else if (IsMoreRelevant(document, matched_documents.front())) {
+                std::pop_heap(matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+                matched_documents.back() = document;
+                std::push_heap(matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+            }
+        });
+        return scored_postings;
+    }
+    accumulator->Finish([&](uint32_t offset, double relevance) {
+        const Slot slot = first + offset;
+        matched_documents.emplace_back(documents_.GetId(slot), relevance, documents_.GetRating(slot));
+    });
+    return scored_postings;
+}
+
+template <typename SlotPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(const Query& query, SlotPredicate slot_predicate, const SearchOptions& options,
+                                                             const SearchBudget* budget) const{
+    const size_t capacity = options.offset + std::min(options.top_k, std::numeric_limits<size_t>::max() - options.offset);
+    std::vector<Document> top_documents;
+    if (capacity == 0) {
+        return top_documents;
+    }
 
-    auto minus_words_proc = [this, &document_to_relevance](std::string_view word){
-        const auto itr = word_to_document_freqs_.find(word);
-        if (itr != word_to_document_freqs_.cend()){
-            for (const auto [document_id, _] : itr->second){
-                document_to_relevance.Erase(document_id);
+    // списки каждого плюс-слова по всем сегментам; курсоры ссылаются в spans, поэтому он заполняется до их создания
+    const QueryArena::Scope arena_scope;
+    std::vector<PostingSpan> spans;
+    std::vector<size_t> span_starts = {0};
+    for (const TermId term_id : query.plus_terms) {
+        ForEachPostingSpan(term_id, 0, DocumentTable::NO_SLOT, [&spans](const PostingSpan& postings) { spans.push_back(postings); });
+        span_starts.push_back(spans.size());
+    }
+    std::vector<double> inverse_document_freqs(query.plus_terms.size());
+    std::vector<TermCursor> cursors;
+    cursors.reserve(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        inverse_document_freqs[i] = ComputeWordInverseDocumentFreq(query.plus_terms[i]);
+        if (span_starts[i] == span_starts[i + 1]) {
+            continue;
+        }
+        float max_term_freq = 0;
+        for (size_t span = span_starts[i]; span < span_starts[i + 1]; ++span) {
+            max_term_freq = std::max(max_term_freq, spans[span].GetMaxTermFreq());
+        }
+        cursors.push_back({spans.data() + span_starts[i], spans.data() + span_starts[i + 1], 0, inverse_document_freqs[i],
+                           max_term_freq * inverse_document_freqs[i]});
+    }
+    // обход складывает вклады в своем порядке; релевантность документа, идущего в выдачу, пересчитывается
+    // по словам запроса в их порядке, как при полном переборе, и суммы совпадают до бита
+    size_t scored_postings = 0;
+    const auto compute_relevance = [&query, &spans, &span_starts, &inverse_document_freqs, &scored_postings](Slot slot) {
+        double relevance = 0;
+        for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+            for (size_t span = span_starts[i]; span < span_starts[i + 1]; ++span) {
+                const PostingSpan& postings = spans[span];
+                if (slot <= postings.GetSlots()[postings.size() - 1]) {
+                    const size_t position = postings.Seek(0, slot);
+                    if (postings.GetSlots()[position] == slot) {
+                        relevance += postings.GetTermFreqs()[position] * inverse_document_freqs[i];
+                        ++scored_postings;
+                    }
+                    break;
+                }
             }
         }
+        return relevance;
     };
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), minus_words_proc);
+    // границы считаются один раз на запрос: prefix_bounds[i] - сумма верхних границ i курсоров с наименьшими границами
+    std::sort(cursors.begin(), cursors.end(), [](const TermCursor& lhs, const TermCursor& rhs) { return lhs.upper_bound < rhs.upper_bound; });
+    std::vector<double> prefix_bounds(cursors.size() + 1, 0);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        prefix_bounds[i + 1] = prefix_bounds[i] + cursors[i].upper_bound;
+    }
 
-    auto document_to_relevance_ordinary = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance_ordinary.size());
-    for (const auto [document_id, relevance] : document_to_relevance_ordinary) {
-        matched_documents.emplace_back(document_id, relevance, documents_.at(document_id).rating);
+    // документ с релевантностью ниже threshold проигрывает худшему в выдаче даже при лучшем рейтинге;
+    // запас в EPSILON покрывает погрешность суммирования верхних границ
+    double threshold = -std::numeric_limits<double>::infinity();
+    // куча с наименее релевантным документом выдачи на вершине
+    top_documents.reserve(std::min(capacity, documents_.GetSlotCount()));
+    // курсоры до first_essential вместе не наберут threshold: документы, найденные только ими, не проверяются
+    size_t first_essential = 0;
+    const size_t window_size = std::min(MAX_SCORE_WINDOW_SLOTS, documents_.GetSlotCount());
+    std::vector<double> relevance(window_size, 0);
+    std::vector<uint8_t> is_touched(window_size, 0);
+    std::vector<uint32_t> touched;
+    touched.reserve(window_size);
+    // window_prefix_bounds - то же, что prefix_bounds, по границам курсоров внутри окна
+    std::vector<double> window_bounds(cursors.size());
+    std::vector<double> window_prefix_bounds(cursors.size() + 1, 0);
+    size_t unchecked_postings = 0;
+
+    // окно начинается с ближайшего вхождения значимых слов. Внутри окна границы курсоров берутся
+    // по максимумам их блоков, и значимыми становятся только те слова, без которых документ окна
+    // не наберет threshold. Их вклады копятся подряд, как при полном переборе, а остальные слова
+    // проверяются только у найденных документов. Бюджет проверяется раз в BUDGET_CHECK_INTERVAL
+    // вхождений; окно, в котором он исчерпан, отбрасывается, и в куче остаются лучшие документы
+    // среди слотов до него
+    bool is_stopped = false;
+    while (!is_stopped) {
+        Slot window_first = DocumentTable::NO_SLOT;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            window_first = std::min(window_first, cursors[i].GetSlot());
+        }
+        if (window_first == DocumentTable::NO_SLOT) {
+            break;
+        }
+        const Slot window_last = static_cast<Slot>(std::min<uint64_t>(uint64_t{window_first} + window_size, DocumentTable::NO_SLOT));
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            cursors[i].Seek(window_first);
+            window_bounds[i] = cursors[i].GetBound(window_last);
+            window_prefix_bounds[i + 1] = window_prefix_bounds[i] + window_bounds[i];
+        }
+        size_t window_first_essential = first_essential;
+        while (window_first_essential < cursors.size() && window_prefix_bounds[window_first_essential + 1] < threshold) {
+            ++window_first_essential;
+        }
+
+        for (size_t i = window_first_essential; i < cursors.size() && !is_stopped; ++i) {
+            TermCursor& cursor = cursors[i];
+            const double other_bounds = window_prefix_bounds.back() - window_bounds[i];
+            while (!cursor.IsExhausted() && cursor.GetSlot() < window_last) {
+                // если блоку не хватит до threshold и вместе с границами остальных курсоров в окне,
+                // ни один документ блока в окне не попадет в выдачу, и эта часть блока пропускается
+                if (cursor.GetBlockBound() + other_bounds < threshold) {
+                    cursor.Seek(std::min(cursor.GetBlockLastSlot() + 1, window_last));
+                    continue;
+                }
+                const PostingSpan& postings = *cursor.span;
+                const uint32_t* const slots = postings.GetSlots();
+                const float* const term_freqs = postings.GetTermFreqs();
+                const size_t block_end = std::min((cursor.position / PostingSpan::BLOCK_SIZE + 1) * PostingSpan::BLOCK_SIZE, postings.size());
+                size_t position = cursor.position;
+                for (; position < block_end && slots[position] < window_last; ++position) {
+                    const uint32_t offset = slots[position] - window_first;
+                    relevance[offset] += term_freqs[position] * cursor.inverse_document_freq;
+                    if (!is_touched[offset]) {
+                        is_touched[offset] = 1;
+                        touched.push_back(offset);
+                    }
+                }
+                scored_postings += position - cursor.position;
+                unchecked_postings += position - cursor.position;
+                cursor.MoveTo(position);
+                if (budget != nullptr && unchecked_postings >= BUDGET_CHECK_INTERVAL) {
+                    unchecked_postings = 0;
+                    if (budget->IsExhausted()) {
+                        is_stopped = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (is_stopped) {
+            break;
+        }
+
+        // документы окна разбираются по возрастанию слотов, чтобы курсоры незначимых слов шли только вперед:
+        // немногие затронутые сортируются, а плотное окно дешевле пройти целиком
+        if (touched.size() * SPARSE_ACCUMULATION_RATIO < window_size) {
+            std::sort(touched.begin(), touched.end());
+        } else {
+            touched.clear();
+            for (uint32_t offset = 0; offset < window_size; ++offset) {
+                if (is_touched[offset]) {
+                    touched.push_back(offset);
+                }
+            }
+        }
+        for (const uint32_t offset : touched) {
+            const Slot slot = window_first + offset;
+            double score = relevance[offset];
+            relevance[offset] = 0;
+            is_touched[offset] = 0;
+            // незначимые курсоры проверяются от больших границ к меньшим, пока документ еще может набрать threshold
+            bool pruned = false;
+            for (size_t i = window_first_essential; i-- > 0;) {
+                if (score + window_prefix_bounds[i + 1] < threshold) {
+                    pruned = true;
+                    break;
+                }
+                TermCursor& cursor = cursors[i];
+                cursor.Seek(slot);
+                if (cursor.GetSlot() == slot) {
+                    score += cursor.GetContribution();
+                    ++scored_postings;
+                }
+            }
+            if (pruned || score < threshold || !slot_predicate(slot)) {
+                continue;
+            }
+
+            const Document document(documents_.GetId(slot), compute_relevance(slot), documents_.GetRating(slot));
+            if (top_documents.size() < capacity) {
+                top_documents.push_back(document);
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            } else if (IsMoreRelevant(document, top_documents.front())) {
+                std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                top_documents.back() = document;
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            } else {
+                continue;
+            }
+            if (top_documents.size() == capacity) {
+                threshold = top_documents.front().relevance - 2 * EPSILON;
+            }
+        }
+        touched.clear();
+        // документы окна, не найденные значимыми словами, не наберут threshold
+        for (size_t i = first_essential; i < window_first_essential; ++i) {
+            cursors[i].Seek(window_last);
+        }
+        // вклады окна уже собраны со значимых курсоров, поэтому граница значимых сдвигается только между окнами
+        while (first_essential < cursors.size() && prefix_bounds[first_essential + 1] < threshold) {
+            ++first_essential;
+        }
+    }
+    if (options.stats != nullptr) {
+        options.stats->scored_postings += scored_postings;
+    }
+
+    std::sort_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+    top_documents.erase(top_documents.begin(), top_documents.begin() + std::min(options.offset, top_documents.size()));
+    return top_documents;
+}
+
+template <typename Callback>
+void SearchServer::ForEachPostingSpan(TermId term_id, Slot first, Slot last, Callback callback) const {
+    auto segment = std::upper_bound(segments_.begin(), segments_.end(), first,
+                                    [](Slot slot, const SegmentRef& ref) { return slot < ref.segment->GetLastSlot(); });
+    for (; segment != segments_.end() && segment->segment->GetFirstSlot() < last; ++segment) {
+        const PostingSpan postings = segment->segment->GetPostings(term_id, &QueryArena::ForThread());
+        if (!postings.empty()) {
+            callback(postings);
+        }
+    }
+    if (mutable_first_slot_ < last) {
+        const PostingSpan postings = term_to_document_freqs_[term_id].GetSpan();
+        if (!postings.empty()) {
+            callback(postings);
+        }
     }
-    return matched_documents;
 }
@@ -0,0 +1,104 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Вектор из кусков по CHUNK_SIZE элементов, которые копии делят между собой: копия
+// берет только указатели на куски, а общий кусок копируется при первой записи в него.
+// Так снимок сервера делит с писателем все, что тот после публикации не менял.
+// Чтение копии безопасно одновременно с записью в другую копию. Несколько потоков
+// могут писать в одну копию только в куски, которые уже принадлежат ей (см. MakeOwned)
+template <typename T>
+class SharedChunkVector {
+public:
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return (*chunks_[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+    }
+    // элемент для записи; общий кусок перед этим копируется
+    T& Mutable(size_t index) {
+        return MakeOwnedChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE];
+    }
+    // делает собственным кусок с элементом index: после этого запись в кусок не копирует его
+    // и может идти из нескольких потоков в разные элементы
+    void MakeOwned(size_t index) {
+        MakeOwnedChunk(index / CHUNK_SIZE);
+    }
+
+    void push_back(T value) {
+        if (size_ % CHUNK_SIZE == 0) {
+            chunks_.push_back(std::make_shared<Chunk>());
+        }
+        MakeOwnedChunk(size_ / CHUNK_SIZE)[size_ % CHUNK_SIZE] = std::move(value);
+        ++size_;
+    }
+    // новые элементы создаются по умолчанию и принадлежат этой копии
+    void resize(size_t size) {
+        if (size > size_ && size_ % CHUNK_SIZE != 0) {
+            // хвост последнего куска мог остаться от прежнего уменьшения размера
+            Chunk& last = MakeOwnedChunk(size_ / CHUNK_SIZE);
+            const size_t end = std::min(size, (size_ / CHUNK_SIZE + 1) * CHUNK_SIZE);
+            for (size_t i = size_; i < end; ++i) {
+                last[i % CHUNK_SIZE] = T{};
+            }
+        }
+        const size_t chunk_count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        if (chunk_count < chunks_.size()) {
+            chunks_.resize(chunk_count);
+        }
+        while (chunks_.size() < chunk_count) {
+            chunks_.push_back(std::make_shared<Chunk>());
+        }
+        size_ = size;
+    }
+    void clear() {
+        chunks_.clear();
+        size_ = 0;
+    }
+
+    // вызывает callback(first_index, data, count) для кусков по порядку
+    template <typename Callback>
+    void ForEachChunk(Callback callback) const {
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            callback(i * CHUNK_SIZE, chunks_[i]->data(), std::min(CHUNK_SIZE, size_ - i * CHUNK_SIZE));
+        }
+    }
+    std::vector<T> ToVector() const {
+        std::vector<T> values;
+        values.reserve(size_);
+        ForEachChunk([&values](size_t, const T* data, size_t count) {
+            values.insert(values.end(), data, data + count);
+        });
+        return values;
+    }
+
+private:
+    using Chunk = std::array<T, CHUNK_SIZE>;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+
+    Chunk& MakeOwnedChunk(size_t chunk_index) {
+        std::shared_ptr<Chunk>& chunk = chunks_[chunk_index];
+        if (chunk.use_count() > 1) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        } else {
+            // другая копия могла только что отпустить кусок в своем потоке:
+            // ее чтения должны завершиться раньше нашей записи
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *chunk;
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+// Хеш-таблица, которую копии делят между собой: общая неизменяемая основа и собственная
+// дельта с ключами, добавленными после пересборки основы. Удаление ключа основу не трогает,
+// поэтому запись основы действительна, только если ее подтверждает владелец (is_current(key, value)).
+// Копия берет основу по указателю и копирует лишь дельту, которая не больше
+// 1/REBUILD_RATIO основы: больше ее не дает пересборка (NeedsRebuild + Rebuild).
+// Основу, которую никто не делит, а ключи не ссылаются в чужую память, копия меняет на месте
+template <typename Key, typename Value>
+class SharedHashIndex {
+public:
+    using Map = std::unordered_map<Key, Value>;
+    static constexpr size_t MIN_DELTA_SIZE = 1024;
+    static constexpr size_t REBUILD_RATIO = 8;
+
+    // значение ключа или nullptr; запись основы проверяется вызовом is_current(key, value)
+    template <typename IsCurrent>
+    const Value* Find(const Key& key, IsCurrent is_current) const {
+        if (const auto itr = delta_.find(key); itr != delta_.end()) {
+            return &itr->second;
+        }
+        if (base_ != nullptr) {
+            if (const auto itr = base_->find(key); itr != base_->end() && is_current(key, itr->second)) {
+                return &itr->second;
+            }
+        }
+        return nullptr;
+    }
+
+    void Insert(const Key& key, Value value) {
+        if (IsBaseOwned()) {
+            base_->insert_or_assign(key, std::move(value));
+            return;
+        }
+        delta_.insert_or_assign(key, std::move(value));
+    }
+    // запись общей основы остается, но владелец больше ее не подтверждает
+    void Erase(const Key& key) {
+        if (IsBaseOwned()) {
+            base_->erase(key);
+            return;
+        }
+        delta_.erase(key);
+        ++erased_count_;
+    }
+
+    bool NeedsRebuild() const {
+        const size_t base_size = base_ == nullptr ? 0 : base_->size();
+        return delta_.size() + erased_count_ > std::max(MIN_DELTA_SIZE, base_size / REBUILD_RATIO);
+    }
+    // переносит дельту в новую основу и выбрасывает неподтвержденные записи старой;
+    // key_storage держит память, на которую ссылаются ключи (например, string_view), пока жива основа
+    template <typename IsCurrent>
+    void Rebuild(IsCurrent is_current, std::shared_ptr<const void> key_storage = nullptr) {
+        Map base;
+        base.reserve((base_ == nullptr ? 0 : base_->size()) + delta_.size());
+        if (base_ != nullptr) {
+            for (const auto& [key, value] : *base_) {
+                if (delta_.count(key) == 0 && is_current(key, value)) {
+                    base.emplace(key, value);
+                }
+            }
+        }
+        base.insert(delta_.begin(), delta_.end());
+        Reset(std::move(base), std::move(key_storage));
+    }
+    // заменяет содержимое: все записи base действительны
+    void Reset(Map base, std::shared_ptr<const void> key_storage = nullptr) {
+        base_ = std::make_shared<Map>(std::move(base));
+        key_storage_ = std::move(key_storage);
+        delta_.clear();
+        erased_count_ = 0;
+    }
+
+private:
+    // меняется только через IsBaseOwned
+    std::shared_ptr<Map> base_ = std::make_shared<Map>();
+    std::shared_ptr<const void> key_storage_;
+    Map delta_;
+    size_t erased_count_ = 0;
+
+    // своя основа забирает дельту, и дальше копия меняет основу на месте
+    bool IsBaseOwned() {
+        if (base_ == nullptr || base_.use_count() > 1 || key_storage_ != nullptr) {
+            return false;
+        }
+        // другая копия могла только что отпустить основу в своем потоке
+        std::atomic_thread_fence(std::memory_order_acquire);
+        for (auto& [key, value] : delta_) {
+            base_->insert_or_assign(key, std::move(value));
+        }
+        delta_.clear();
+        return true;
+    }
+};
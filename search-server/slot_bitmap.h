@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Плотное битовое множество слотов документов.
+class SlotBitmap {
+public:
+    SlotBitmap() = default;
+    explicit SlotBitmap(size_t size)
+        : size_(size), words_((size + 63) / 64, 0) {
+    }
+
+    void Set(uint32_t slot) {
+        words_[slot / 64] |= uint64_t{1} << (slot % 64);
+    }
+    void Reset(uint32_t slot) {
+        words_[slot / 64] &= ~(uint64_t{1} << (slot % 64));
+    }
+    bool Test(uint32_t slot) const {
+        return (words_[slot / 64] >> (slot % 64)) & 1;
+    }
+    // новые слоты не входят в множество
+    void Resize(size_t size) {
+        size_ = size;
+        words_.resize((size + 63) / 64, 0);
+    }
+
+    // операции над множествами одного размера
+    SlotBitmap& operator|=(const SlotBitmap& other) {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            words_[i] |= other.words_[i];
+        }
+        return *this;
+    }
+    // объединяет слова с номера first_word с count готовыми словами другого множества
+    void OrWords(size_t first_word, const uint64_t* words, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            words_[first_word + i] |= words[i];
+        }
+    }
+    SlotBitmap& AndNot(const SlotBitmap& other) {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            words_[i] &= ~other.words_[i];
+        }
+        return *this;
+    }
+
+    // вызывает callback(slot) для каждого слота множества по возрастанию
+    template <typename Callback>
+    void ForEach(Callback callback) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            for (uint64_t word = words_[i]; word != 0; word &= word - 1) {
+                callback(static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+
+    // то же, пока callback возвращает true; возвращает false, если обход остановлен
+    template <typename Callback>
+    bool ForEachWhile(Callback callback) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            for (uint64_t word = words_[i]; word != 0; word &= word - 1) {
+                if (!callback(static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    size_t size_ = 0;
+    std::vector<uint64_t> words_;
+};
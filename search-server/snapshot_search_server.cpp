@@ -0,0 +1,61 @@
+#include "snapshot_search_server.h"
+#include "process_queries.h"
+
+#include <utility>
+
+SnapshotSearchServer::SnapshotSearchServer(SearchServer search_server)
+    : writer_(std::move(search_server)) {
+    Publish();
+}
+
+std::shared_ptr<const SearchServer> SnapshotSearchServer::GetSnapshot() const {
+    return std::atomic_load(&snapshot_);
+}
+
+uint64_t SnapshotSearchServer::GetVersion() const {
+    return version_.load();
+}
+
+void SnapshotSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    std::lock_guard guard(writer_mutex_);
+    writer_.AddDocument(document_id, document, status, ratings);
+}
+
+void SnapshotSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::lock_guard guard(writer_mutex_);
+    writer_.AddDocuments(documents);
+}
+
+void SnapshotSearchServer::RemoveDocument(int document_id) {
+    std::lock_guard guard(writer_mutex_);
+    writer_.RemoveDocument(document_id);
+}
+
+void SnapshotSearchServer::CompactPostings() {
+    std::lock_guard guard(writer_mutex_);
+    writer_.CompactPostings();
+}
+
+void SnapshotSearchServer::Maintain() {
+    std::lock_guard guard(writer_mutex_);
+    writer_.Maintain();
+}
+
+void SnapshotSearchServer::Publish() {
+    std::lock_guard guard(writer_mutex_);
+    // после заморозки все вхождения лежат в сегментах, которые копия делит с писателем,
+    // а остальные части индекса копия делит с писателем по кускам
+    writer_.Refresh();
+    std::shared_ptr<const SearchServer> snapshot = std::make_shared<const SearchServer>(writer_);
+    std::atomic_store(&snapshot_, std::move(snapshot));
+    ++version_;
+}
+
+std::vector<Document> SnapshotSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+    return GetSnapshot()->FindTopDocuments(raw_query, status);
+}
+
+std::vector<std::vector<Document>> SnapshotSearchServer::ProcessQueries(const std::vector<std::string>& queries) const {
+    const auto snapshot = GetSnapshot();
+    return ::ProcessQueries(*snapshot, queries);
+}
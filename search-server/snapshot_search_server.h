@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Поисковый сервер, который ищет и меняет индекс одновременно. Читатель берет
+// неизменяемый снимок индекса и ищет по нему без блокировок. Единственный писатель
+// меняет свою копию и публикует ее как новый снимок. Старый снимок освобождается,
+// когда его отпускает последний читатель. Замороженные сегменты вхождений, словарь,
+// таблицу документов и прямой индекс снимки делят с писателем: публикация копирует
+// только указатели на куски, а писатель копирует кусок при первой записи в него.
+class SnapshotSearchServer {
+public:
+    explicit SnapshotSearchServer(SearchServer search_server);
+
+    // текущий опубликованный снимок; не меняется, пока его держат
+    std::shared_ptr<const SearchServer> GetSnapshot() const;
+    // номер опубликованного снимка, растет с каждой публикацией
+    uint64_t GetVersion() const;
+
+    // изменения писателя видны читателям только после Publish
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    void CompactPostings();
+    // шаг обслуживания писателя (см. SearchServer::Maintain); вызывается отдельно от изменений
+    void Maintain();
+    // замораживает изменяемый сегмент писателя и публикует копию его индекса
+    void Publish();
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    // все запросы пакета выполняются по одному снимку
+    std::vector<std::vector<Document>> ProcessQueries(const std::vector<std::string>& queries) const;
+
+private:
+    std::mutex writer_mutex_;
+    SearchServer writer_;
+    // читается и заменяется атомарно через std::atomic_load/std::atomic_store
+    std::shared_ptr<const SearchServer> snapshot_;
+    std::atomic<uint64_t> version_ = 0;
+};
@@ -0,0 +1,114 @@
+#include "stream_vbyte.h"
+#include <array>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_HAS_SSSE3_KERNEL
+#include <tmmintrin.h>
+#endif
+
+namespace {
+
+int GetValueLength(uint8_t control, size_t index) {
+    return ((control >> (2 * index)) & 3) + 1;
+}
+
+const uint8_t* DecodeScalar(const uint8_t* control, const uint8_t* data, size_t first, size_t count, bool is_delta,
+                            uint32_t previous, uint32_t* out) {
+    for (size_t i = first; i < count; ++i) {
+        const int length = GetValueLength(control[i / 4], i % 4);
+        uint32_t value = 0;
+        for (int byte = 0; byte < length; ++byte) {
+            value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+        }
+        data += length;
+        previous = is_delta ? previous + value : value;
+        out[i] = previous;
+    }
+    return data;
+}
+
+#ifdef SEARCH_SERVER_HAS_SSSE3_KERNEL
+
+struct ShuffleTables {
+    // для каждого управляющего байта: маска перестановки четырех чисел и их суммарная длина
+    std::array<std::array<int8_t, 16>, 256> masks;
+    std::array<uint8_t, 256> lengths;
+};
+
+ShuffleTables MakeShuffleTables() {
+    ShuffleTables tables;
+    for (int control = 0; control < 256; ++control) {
+        int8_t source = 0;
+        for (size_t value = 0; value < 4; ++value) {
+            const int length = GetValueLength(static_cast<uint8_t>(control), value);
+            for (int byte = 0; byte < 4; ++byte) {
+                tables.masks[control][value * 4 + byte] = byte < length ? source++ : -1;
+            }
+        }
+        tables.lengths[control] = static_cast<uint8_t>(source);
+    }
+    return tables;
+}
+
+const ShuffleTables& GetShuffleTables() {
+    static const ShuffleTables tables = MakeShuffleTables();
+    return tables;
+}
+
+bool HasSsse3() {
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    return has_ssse3;
+}
+
+// распаковывает по четыре числа за шаг; разности сразу складываются префиксной суммой
+template <bool IS_DELTA>
+__attribute__((target("ssse3")))
+const uint8_t* DecodeSsse3(const uint8_t* control, const uint8_t* data, size_t count, uint32_t* out) {
+    const ShuffleTables& tables = GetShuffleTables();
+    __m128i running = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint8_t control_byte = control[i / 4];
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.masks[control_byte].data()));
+        __m128i values = _mm_shuffle_epi8(packed, mask);
+        if constexpr (IS_DELTA) {
+            values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+            values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+            values = _mm_add_epi32(values, running);
+            running = _mm_shuffle_epi32(values, 0xFF);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), values);
+        data += tables.lengths[control_byte];
+    }
+    return DecodeScalar(control, data, i, count, IS_DELTA, static_cast<uint32_t>(_mm_cvtsi128_si32(running)), out);
+}
+
+#endif
+
+} // namespace
+
+void EncodeStreamVByte(const uint32_t* values, size_t count, bool is_delta, std::vector<uint8_t>& out) {
+    const size_t control = out.size();
+    out.resize(out.size() + (count + 3) / 4, 0);
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t value = is_delta ? values[i] - previous : values[i];
+        previous = values[i];
+        const int length = value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+        out[control + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+        for (int byte = 0; byte < length; ++byte) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+        }
+    }
+}
+
+const uint8_t* DecodeStreamVByte(const uint8_t* in, size_t count, bool is_delta, uint32_t* out) {
+    const uint8_t* const data = in + (count + 3) / 4;
+#ifdef SEARCH_SERVER_HAS_SSSE3_KERNEL
+    if (HasSsse3()) {
+        return is_delta ? DecodeSsse3<true>(in, data, count, out) : DecodeSsse3<false>(in, data, count, out);
+    }
+#endif
+    return DecodeScalar(in, data, 0, count, is_delta, 0, out);
+}
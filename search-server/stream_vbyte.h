@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Кодирование чисел в формате StreamVByte: на каждое число 2 бита длины в управляющих байтах
+// и от 1 до 4 байт данных; управляющие байты всех чисел потока идут перед их данными.
+// Распаковка использует SSSE3, если процессор его поддерживает, и читает данные по 16 байт,
+// поэтому за последним потоком буфера должно быть STREAM_VBYTE_PADDING доступных байт.
+constexpr size_t STREAM_VBYTE_PADDING = 16;
+
+// дописывает поток count чисел в out; с is_delta кодируются разности соседних чисел,
+// и values должны не убывать
+void EncodeStreamVByte(const uint32_t* values, size_t count, bool is_delta, std::vector<uint8_t>& out);
+// распаковывает поток count чисел в out и возвращает указатель за ним
+const uint8_t* DecodeStreamVByte(const uint8_t* in, size_t count, bool is_delta, uint32_t* out);
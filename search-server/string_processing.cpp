@@ -1,12 +1,81 @@
 #include "string_processing.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_HAS_X86_TOKENIZER
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void ClassifyBytesScalar(const char* data, size_t size, uint64_t& spaces, uint64_t& controls) {
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const char c = data[i];
+        spaces |= static_cast<uint64_t>(c == ' ') << i;
+        controls |= static_cast<uint64_t>(c >= '\0' && c < ' ') << i;
+    }
+}
+
+#ifdef SEARCH_SERVER_HAS_X86_TOKENIZER
+
+bool HasAvx2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+// байты со знаком: управляющие символы - это 0 <= c < 32, байты UTF-8 отрицательны
+__attribute__((target("sse2")))
+void ClassifyBlockSse2(const char* data, uint64_t& spaces, uint64_t& controls) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    spaces = 0;
+    controls = 0;
+    for (int part = 0; part < 4; ++part) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * part));
+        const __m128i is_space = _mm_cmpeq_epi8(bytes, space);
+        const __m128i is_control = _mm_and_si128(_mm_cmplt_epi8(bytes, space), _mm_cmpgt_epi8(bytes, minus_one));
+        spaces |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(is_space))) << (16 * part);
+        controls |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(is_control))) << (16 * part);
+    }
+}
+
+__attribute__((target("avx2")))
+void ClassifyBlockAvx2(const char* data, uint64_t& spaces, uint64_t& controls) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i minus_one = _mm256_set1_epi8(-1);
+    spaces = 0;
+    controls = 0;
+    for (int part = 0; part < 2; ++part) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32 * part));
+        const __m256i is_space = _mm256_cmpeq_epi8(bytes, space);
+        const __m256i is_control = _mm256_and_si256(_mm256_cmpgt_epi8(space, bytes), _mm256_cmpgt_epi8(bytes, minus_one));
+        spaces |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_space))) << (32 * part);
+        controls |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_control))) << (32 * part);
+    }
+}
+
+#endif
+
+} // namespace
+
+void ClassifyBytes(const char* data, size_t size, uint64_t& spaces, uint64_t& controls) {
+#ifdef SEARCH_SERVER_HAS_X86_TOKENIZER
+    // неполный блок в конце текста разбирается по байтам, чтобы не читать за его границу
+    if (size < 64) {
+        ClassifyBytesScalar(data, size, spaces, controls);
+    } else if (HasAvx2()) {
+        ClassifyBlockAvx2(data, spaces, controls);
+    } else {
+        ClassifyBlockSse2(data, spaces, controls);
+    }
+#else
+    ClassifyBytesScalar(data, size, spaces, controls);
+#endif
+}
+
 std::vector<std::string_view> SplitIntoWordsStringView(std::string_view text) {
     std::vector<std::string_view> words;
-    while (!text.empty()) {
-        auto space = text.find(' ');
-        if (space == text.npos) words.push_back(text.substr(0, text.size()));
-        else  words.push_back(text.substr(0, space));
-        text.remove_prefix(std::min(text.find_first_not_of(' ', space), text.size()));
-    }
+    ForEachToken(text, [&words](std::string_view word, bool) { words.push_back(word); });
     return words;
 }
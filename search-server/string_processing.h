@@ -3,9 +3,66 @@
 #include <vector>
 #include <set>
 #include <string_view>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 
 std::vector<std::string_view> SplitIntoWordsStringView(std::string_view text);
 
+// для size <= 64 байт строит маски пробелов и управляющих символов (коды 0..31):
+// бит i соответствует data[i]. Ядро AVX2, SSE2 или скалярное выбирается по процессору
+void ClassifyBytes(const char* data, size_t size, uint64_t& spaces, uint64_t& controls);
+
+// за один проход по блокам в 64 байта делит текст на слова по пробелам и для каждого
+// сообщает, есть ли в нем управляющие символы: callback(word, has_control_chars)
+template <typename Callback>
+void ForEachToken(std::string_view text, Callback callback) {
+    // пробелы в начале текста дают одно пустое слово, как и прежнее деление на слова
+    if (!text.empty() && text[0] == ' ') {
+        callback(text.substr(0, 0), false);
+    }
+    bool in_word = false;
+    bool word_has_controls = false;
+    size_t word_begin = 0;
+    for (size_t block = 0; block < text.size(); block += 64) {
+        const size_t block_size = std::min<size_t>(64, text.size() - block);
+        uint64_t spaces = 0;
+        uint64_t controls = 0;
+        ClassifyBytes(text.data() + block, block_size, spaces, controls);
+        const uint64_t valid = block_size == 64 ? ~uint64_t{0} : (uint64_t{1} << block_size) - 1;
+        const uint64_t letters = ~spaces & valid;
+        size_t i = 0;
+        while (i < block_size) {
+            const uint64_t from_i = valid & (~uint64_t{0} << i);
+            if (!in_word) {
+                const uint64_t rest = letters & from_i;
+                if (rest == 0) {
+                    break;
+                }
+                i = __builtin_ctzll(rest);
+                in_word = true;
+                word_has_controls = false;
+                word_begin = block + i;
+                continue;
+            }
+            const uint64_t rest = spaces & from_i;
+            const size_t end = rest == 0 ? block_size : __builtin_ctzll(rest);
+            const uint64_t word_bits = from_i & (end == 64 ? ~uint64_t{0} : (uint64_t{1} << end) - 1);
+            word_has_controls |= (controls & word_bits) != 0;
+            if (rest == 0) {
+                // слово продолжается в следующем блоке
+                break;
+            }
+            callback(text.substr(word_begin, block + end - word_begin), word_has_controls);
+            in_word = false;
+            i = end;
+        }
+    }
+    if (in_word) {
+        callback(text.substr(word_begin), word_has_controls);
+    }
+}
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -16,4 +73,3 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
     }
     return non_empty_strings;
 }
-
@@ -0,0 +1,127 @@
+#include "term_dictionary.h"
+
+TermDictionary::TermId TermDictionary::Intern(std::string_view word) {
+    if (const TermId term_id = Find(word); term_id != NO_TERM) {
+        return term_id;
+    }
+    const std::string_view stored = arena_.Store(word);
+    TermId term_id = static_cast<TermId>(terms_.size());
+    if (free_ids_.empty()) {
+        terms_.push_back(stored);
+        is_live_.push_back(true);
+    } else {
+        term_id = free_ids_[free_ids_.size() - 1];
+        free_ids_.resize(free_ids_.size() - 1);
+        terms_.Mutable(term_id) = stored;
+        is_live_.Mutable(term_id) = true;
+    }
+    term_ids_.Insert(stored, term_id);
+    RebuildIndexIfNeeded();
+    return term_id;
+}
+
+void TermDictionary::Release(TermId term_id) {
+    // ключ удаляется раньше строки, на которую он ссылается
+    term_ids_.Erase(terms_[term_id]);
+    arena_.Release(terms_[term_id]);
+    terms_.Mutable(term_id) = {};
+    is_live_.Mutable(term_id) = false;
+    free_ids_.push_back(term_id);
+    RebuildIndexIfNeeded();
+}
+
+TermDictionary::TermId TermDictionary::Find(std::string_view word) const {
+    const TermId* const term_id = term_ids_.Find(word, [this](std::string_view key, TermId id) { return IsCurrent(key, id); });
+    return term_id == nullptr ? NO_TERM : *term_id;
+}
+
+std::string_view TermDictionary::GetTerm(TermId term_id) const {
+    return terms_[term_id];
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return terms_.size();
+}
+
+void TermDictionary::Compact() {
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (!is_live_[term_id] || !arena_.IsInSparseChunk(terms_[term_id])) {
+            continue;
+        }
+        const std::string_view moved = arena_.Store(terms_[term_id]);
+        arena_.Release(terms_[term_id]);
+        terms_.Mutable(term_id) = moved;
+    }
+    // ключи поиска указывали на перенесенные строки
+    ResetIndex();
+}
+
+bool TermDictionary::NeedsCompaction() const {
+    return arena_.NeedsCompaction();
+}
+
+const TextArena& TermDictionary::GetArena() const {
+    return arena_;
+}
+
+void TermDictionary::Save(IndexFileWriter& writer) const {
+    std::vector<uint64_t> offsets = {0};
+    std::vector<char> text;
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        text.insert(text.end(), terms_[term_id].begin(), terms_[term_id].end());
+        offsets.push_back(text.size());
+    }
+    writer.WriteArray(is_live_.ToVector());
+    writer.WriteArray(offsets);
+    writer.WriteArray(text);
+    writer.WriteArray(free_ids_.ToVector());
+}
+
+void TermDictionary::Load(IndexSectionReader& reader) {
+    const auto is_live = reader.ReadArray<uint8_t>();
+    const auto offsets = reader.ReadArray<uint64_t>();
+    const auto text = reader.ReadArray<char>();
+    const auto free_ids = reader.ReadArray<TermId>();
+    if (offsets.size != is_live.size + 1 || offsets[0] != 0 || offsets[is_live.size] != text.size) {
+        throw std::runtime_error("Поврежден файл индекса: несогласованный словарь");
+    }
+    terms_.resize(is_live.size);
+    is_live_.resize(is_live.size);
+    for (TermId term_id = 0; term_id < is_live.size; ++term_id) {
+        if (offsets[term_id] > offsets[term_id + 1] || offsets[term_id + 1] > text.size) {
+            throw std::runtime_error("Поврежден файл индекса: несогласованный словарь");
+        }
+        if (is_live[term_id]) {
+            terms_.Mutable(term_id) = arena_.Store({text.data + offsets[term_id], offsets[term_id + 1] - offsets[term_id]});
+            is_live_.Mutable(term_id) = true;
+        }
+    }
+    for (const TermId term_id : free_ids) {
+        if (term_id >= terms_.size() || is_live_[term_id]) {
+            throw std::runtime_error("Поврежден файл индекса: несогласованный словарь");
+        }
+        free_ids_.push_back(term_id);
+    }
+    ResetIndex();
+}
+
+bool TermDictionary::IsCurrent(std::string_view word, TermId term_id) const {
+    return is_live_[term_id] && terms_[term_id] == word;
+}
+
+void TermDictionary::RebuildIndexIfNeeded() {
+    if (term_ids_.NeedsRebuild()) {
+        term_ids_.Rebuild([this](std::string_view key, TermId id) { return IsCurrent(key, id); }, arena_.PinChunks());
+    }
+}
+
+void TermDictionary::ResetIndex() {
+    SharedHashIndex<std::string_view, TermId>::Map term_ids;
+    term_ids.reserve(terms_.size());
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (is_live_[term_id]) {
+            term_ids.emplace(terms_[term_id], term_id);
+        }
+    }
+    term_ids_.Reset(std::move(term_ids), arena_.PinChunks());
+}
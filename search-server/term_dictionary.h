@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "index_file.h"
+#include "shared_chunk_vector.h"
+#include "shared_hash_index.h"
+#include "text_arena.h"
+
+// Словарь терминов: каждому различному слову сопоставляется плотный числовой идентификатор.
+// Строки терминов хранятся в собственной арене. Идентификаторы освобожденных терминов
+// выдаются новым словам повторно. Копии делят строки, куски таблиц и основу поиска по слову,
+// поэтому копия стоит пропорционально словам, добавленным после пересборки основы.
+class TermDictionary {
+public:
+    using TermId = uint32_t;
+    static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermDictionary() = default;
+    // копия и перенос не копируют строки: выданные string_view действительны
+    TermDictionary(const TermDictionary& other) = default;
+    TermDictionary& operator=(const TermDictionary& other) = default;
+    TermDictionary(TermDictionary&& other) noexcept = default;
+    TermDictionary& operator=(TermDictionary&& other) noexcept = default;
+
+    TermId Intern(std::string_view word);
+    // строка термина освобождается, а идентификатор становится свободным
+    void Release(TermId term_id);
+    TermId Find(std::string_view word) const;
+    std::string_view GetTerm(TermId term_id) const;
+    // размер пространства идентификаторов, включая свободные
+    size_t GetTermCount() const;
+
+    // переносит строки из полупустых кусков арены; строки, полученные от GetTerm,
+    // после уплотнения недействительны
+    void Compact();
+    bool NeedsCompaction() const;
+    const TextArena& GetArena() const;
+
+    void Save(IndexFileWriter& writer) const;
+    // читает словарь в пустой словарь; строки копируются в арену
+    void Load(IndexSectionReader& reader);
+
+private:
+    TextArena arena_;
+    // запись основы действительна, пока ее идентификатор принадлежит тому же слову
+    SharedHashIndex<std::string_view, TermId> term_ids_;
+    SharedChunkVector<std::string_view> terms_;
+    SharedChunkVector<uint8_t> is_live_;
+    SharedChunkVector<TermId> free_ids_;
+
+    bool IsCurrent(std::string_view word, TermId term_id) const;
+    void RebuildIndexIfNeeded();
+    // заново строит поиск по слову из таблицы терминов
+    void ResetIndex();
+};
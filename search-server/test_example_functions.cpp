@@ -2,7 +2,19 @@
 //#include "remove_duplicates.h"
 #include "request_queue.h"
 #include "process_queries.h"
+#include "snapshot_search_server.h"
+#include "durable_search_server.h"
+#include "corpus_loader.h"
+#include "search_executor.h"
+#include <chrono>
 #include <execution>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 std::string GenerateWord(std::mt19937& generator, int max_length) {
@@ -49,6 +61,32 @@ std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vec
     return queries;
 }
 
+std::vector<std::string> GenerateTopicalTexts(std::mt19937& generator, const std::vector<std::string>& dictionary, int text_count, int topic_count,
+                                              int background_word_count, int topic_word_count) {
+    // первые BACKGROUND_SIZE слов словаря общие, за ними идут словари тем по TOPIC_SIZE слов
+    const size_t BACKGROUND_SIZE = 200;
+    const size_t TOPIC_SIZE = 20;
+    std::vector<double> weights(BACKGROUND_SIZE);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    std::discrete_distribution<size_t> background_word(weights.begin(), weights.end());
+    std::uniform_int_distribution<size_t> topic_word(0, TOPIC_SIZE - 1);
+    std::vector<std::string> texts;
+    texts.reserve(text_count);
+    for (int i = 0; i < text_count; ++i) {
+        std::string text;
+        for (int j = 0; j < background_word_count; ++j) {
+            text += dictionary[background_word(generator)] + ' ';
+        }
+        for (int j = 0; j < topic_word_count; ++j) {
+            text += dictionary[BACKGROUND_SIZE + (i % topic_count) * TOPIC_SIZE + topic_word(generator)] + ' ';
+        }
+        texts.push_back(move(text));
+    }
+    return texts;
+}
+
 using namespace std;
 void PrintMatchDocumentResultUTestOver(int document_id, const std::vector<std::string_view>& words, DocumentStatus status) {
     std::cout << "{ "
@@ -101,6 +139,45 @@ void TestSearchServer() {
     RUN_TEST(TestPerformanceParallelMatching);
     RUN_TEST(TestParallelFindTopDocuments);
     RUN_TEST(TestPerformanceParallelFindTop);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestPostingList);
+    RUN_TEST(TestDocumentPositionalAccess);
+    RUN_TEST(TestPerformanceDocumentIdOrder);
+    RUN_TEST(TestTopDocumentsWindow);
+    RUN_TEST(TestMaxScoreMatchesExhaustive);
+    RUN_TEST(TestMaxScoreScoredPostings);
+    RUN_TEST(TestPerformanceMaxScore);
+    RUN_TEST(TestInverseDocumentFreqAfterRemove);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestQueryResultCache);
+    RUN_TEST(TestQueryArena);
+    RUN_TEST(TestTokenizer);
+    RUN_TEST(TestPerformanceTokenizer);
+    RUN_TEST(TestTermStorageReclaim);
+    RUN_TEST(TestTombstoneDelete);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestPerformanceAddDocuments);
+    RUN_TEST(TestSegmentedIndex);
+    RUN_TEST(TestPerformanceRefresh);
+    RUN_TEST(TestCompressedSegments);
+    RUN_TEST(TestPerformanceCompressedSegments);
+    RUN_TEST(TestSnapshotSearchServer);
+    RUN_TEST(TestPerformancePublish);
+    RUN_TEST(TestSaveLoad);
+    RUN_TEST(TestPerformanceLoad);
+    RUN_TEST(TestDurableSearchServer);
+    RUN_TEST(TestPerformanceWriteAheadLog);
+    RUN_TEST(TestLoadCorpus);
+    RUN_TEST(TestPerformanceLoadCorpus);
+    RUN_TEST(TestFindTopDocumentsBatch);
+    RUN_TEST(TestPerformanceBatchQueries);
+    RUN_TEST(TestPerformanceSparseBatchQueries);
+    RUN_TEST(TestJoinedResults);
+    RUN_TEST(TestPerformanceJoinedResults);
+    RUN_TEST(TestSearchBudget);
+    RUN_TEST(TestPerformanceSearchBudget);
+    RUN_TEST(TestRareWordAccumulation);
+    RUN_TEST(TestPerformanceRareWordQueries);
 }
 
 // Тест проверяет, что поисковая система исключает стоп-слова при добавлении документов
@@ -649,3 +726,2159 @@ void TestPerformanceParallelFindTop(){
     //TEST(par);
     Test("no policy", search_server, queries);
 }
+
+//Тест словаря терминов
+void TestTermDictionary(){
+    const vector<string> words = {"cat"s, "dog"s, "cat"s, "rat"s};
+    TermDictionary dictionary;
+    ASSERT_EQUAL(dictionary.Find("cat"), TermDictionary::NO_TERM);
+
+    vector<TermDictionary::TermId> ids;
+    for (const string& word : words) {
+        ids.push_back(dictionary.Intern(word));
+    }
+    // повторное слово получает прежний идентификатор, новые - следующие по порядку
+    ASSERT_EQUAL(ids[0], 0u);
+    ASSERT_EQUAL(ids[1], 1u);
+    ASSERT_EQUAL(ids[2], 0u);
+    ASSERT_EQUAL(ids[3], 2u);
+    ASSERT_EQUAL(dictionary.GetTermCount(), 3u);
+    ASSERT_EQUAL(dictionary.Find("rat"), 2u);
+    ASSERT_EQUAL(dictionary.GetTerm(1), "dog"s);
+}
+
+//Тест списка вхождений термина
+void TestPostingList(){
+    PostingList postings;
+    postings.Add(5, 0.5);
+    postings.Add(9, 0.25);
+    // документ с меньшим слотом встает на свое место
+    postings.Add(2, 0.125);
+    ASSERT_EQUAL(postings.size(), 3u);
+    ASSERT(postings.GetSlots() == vector<uint32_t>({2, 5, 9}));
+    ASSERT_EQUAL(postings.GetTermFreqs()[0], 0.125f);
+    ASSERT(postings.Contains(5));
+
+    ASSERT(postings.Remove(5));
+    ASSERT(!postings.Remove(5));
+    ASSERT(!postings.Contains(5));
+    ASSERT(postings.GetSlots() == vector<uint32_t>({2, 9}));
+    ASSERT_EQUAL(postings.GetTermFreqs()[1], 0.25f);
+
+    // максимумы блоков
+    PostingList long_postings;
+    for (uint32_t slot = 0; slot < 2 * PostingList::BLOCK_SIZE; ++slot) {
+        long_postings.Add(slot * 2, slot == 10 ? 0.75 : 0.125);
+    }
+    ASSERT_EQUAL(long_postings.GetBlockMaxTermFreq(0), 0.75f);
+    ASSERT_EQUAL(long_postings.GetBlockMaxTermFreq(PostingList::BLOCK_SIZE), 0.125f);
+    ASSERT_EQUAL(long_postings.GetBlockLastSlot(3), (PostingList::BLOCK_SIZE - 1) * 2);
+    // удаление сдвигает вхождения в предыдущий блок
+    long_postings.Remove(20);
+    ASSERT_EQUAL(long_postings.GetBlockMaxTermFreq(0), 0.125f);
+    ASSERT_EQUAL(long_postings.GetBlockLastSlot(0), PostingList::BLOCK_SIZE * 2);
+    long_postings.Add(1, 0.5);
+    ASSERT_EQUAL(long_postings.GetBlockMaxTermFreq(0), 0.5f);
+}
+
+//Тест позиционного доступа к документам и обхода их id
+void TestDocumentPositionalAccess(){
+    SearchServer server("и в на"s);
+    server.AddDocument(7, "белый кот", DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "пушистый пёс", DocumentStatus::BANNED, {2});
+    server.AddDocument(5, "модный ошейник", DocumentStatus::ACTUAL, {3});
+
+    // позиция определяется порядком id, а не порядком добавления
+    ASSERT_EQUAL(server.GetDocumentId(0), 3);
+    ASSERT_EQUAL(server.GetDocumentId(1), 5);
+    ASSERT_EQUAL(server.GetDocumentId(2), 7);
+
+    server.RemoveDocument(5);
+    vector<int> ids(server.begin(), server.end());
+    ASSERT(ids == vector<int>({3, 7}));
+    ASSERT_EQUAL(server.GetDocumentId(1), 7);
+
+    bool thrown = false;
+    try {
+        server.GetDocumentId(2);
+    } catch (const out_of_range&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Index past the last document must be rejected");
+
+    // список id пересобирается после удалений и добавлений не по порядку, в том числе в копии
+    server.AddDocument(1, "серый кот", DocumentStatus::ACTUAL, {1});
+    server.RemoveDocument(3);
+    const SearchServer copy = server;
+    server.AddDocument(9, "рыжий кот", DocumentStatus::ACTUAL, {1});
+    ASSERT(vector<int>(server.begin(), server.end()) == vector<int>({1, 7, 9}));
+    ASSERT_EQUAL(copy.GetDocumentId(0), 1);
+    ASSERT_EQUAL(copy.GetDocumentId(1), 7);
+    ASSERT_EQUAL(copy.GetDocumentCount(), 2);
+}
+
+void TestPerformanceDocumentIdOrder(){
+    mt19937 generator;
+    vector<int> ids(100'000);
+    iota(ids.begin(), ids.end(), 0);
+    shuffle(ids.begin(), ids.end(), generator);
+    SearchServer search_server(""s);
+    {
+        LOG_DURATION("add and remove in random id order"s);
+        for (const int id : ids) {
+            search_server.AddDocument(id, "word"s, DocumentStatus::ACTUAL, {1});
+        }
+        shuffle(ids.begin(), ids.end(), generator);
+        for (size_t i = 0; i < ids.size() / 2; ++i) {
+            search_server.RemoveDocument(ids[i]);
+        }
+        ASSERT_EQUAL(search_server.GetDocumentId(0), *min_element(ids.begin() + ids.size() / 2, ids.end()));
+    }
+}
+
+//Тест выдачи с заданным числом документов и смещением
+void TestTopDocumentsWindow(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 100, 5);
+    const auto documents = GenerateQueries(generator, dictionary, 300, 20);
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+    const string query = GenerateQuery(generator, dictionary, 10);
+
+    const auto all_docs = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, {documents.size(), 0});
+    ASSERT(all_docs.size() > 20);
+    // по умолчанию возвращается MAX_RESULT_DOCUMENT_COUNT документов
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    const auto check_window = [&all_docs](const vector<Document>& found_docs, size_t top_k, size_t offset) {
+        ASSERT_EQUAL(found_docs.size(), min(top_k, all_docs.size() - min(offset, all_docs.size())));
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT(fabs(found_docs[i].relevance - all_docs[offset + i].relevance) < EPSILON);
+            ASSERT_EQUAL(found_docs[i].rating, all_docs[offset + i].rating);
+        }
+    };
+    for (const auto& [top_k, offset] : vector<pair<size_t, size_t>>{{1, 0}, {10, 0}, {7, 5}, {5, all_docs.size() - 2}, {3, all_docs.size()}}) {
+        check_window(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, {top_k, offset}), top_k, offset);
+        check_window(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, {top_k, offset}), top_k, offset);
+    }
+}
+
+//Тест совпадения выдачи MaxScore с полным перебором
+void TestMaxScoreMatchesExhaustive(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 5);
+    const auto documents = GenerateQueries(generator, dictionary, 2000, 30);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 5)});
+    }
+    search_server.RemoveDocument(10);
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(fabs(lhs[i].relevance - rhs[i].relevance) < EPSILON);
+        }
+    };
+    const auto even_ids = [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; };
+    for (const string& query : GenerateQueries(generator, dictionary, 50, 8)) {
+        const string query_with_minus = query + " -"s + dictionary[uniform_int_distribution<size_t>(1, dictionary.size() - 1)(generator)];
+        for (const SearchOptions& options : {SearchOptions{}, SearchOptions{20, 0}, SearchOptions{10, 7}}) {
+            SearchOptions max_score_options = options;
+            max_score_options.mode = EvaluationMode::MAX_SCORE;
+            check_equal(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score_options),
+                        search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options));
+            check_equal(search_server.FindTopDocuments(query_with_minus, DocumentStatus::ACTUAL, max_score_options),
+                        search_server.FindTopDocuments(query_with_minus, DocumentStatus::ACTUAL, options));
+            check_equal(search_server.FindTopDocuments(query, even_ids, max_score_options),
+                        search_server.FindTopDocuments(query, even_ids, options));
+        }
+    }
+}
+
+//Тест числа вхождений, оцененных MaxScore
+void TestMaxScoreScoredPostings(){
+    // у общих слов длинные списки и малая обратная частота, а выдачу длинного запроса
+    // решают редкие слова его темы
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 3000, 10);
+    const auto texts = GenerateTopicalTexts(generator, dictionary, 20'000, 100, 40, 10);
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+
+    SearchStats exhaustive_stats;
+    SearchStats max_score_stats;
+    for (const string& query : GenerateTopicalTexts(generator, dictionary, 20, 100, 10, 8)) {
+        SearchOptions options;
+        options.stats = &exhaustive_stats;
+        const auto expected_docs = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+        options.mode = EvaluationMode::MAX_SCORE;
+        options.stats = &max_score_stats;
+        const auto found_docs = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+        ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+            ASSERT(fabs(found_docs[i].relevance - expected_docs[i].relevance) < EPSILON);
+        }
+    }
+    // полный перебор оценивает каждое вхождение плюс-слов, MaxScore - на порядок меньше
+    ASSERT(exhaustive_stats.scored_postings > 0);
+    ASSERT_HINT(max_score_stats.scored_postings * 10 < exhaustive_stats.scored_postings,
+                to_string(max_score_stats.scored_postings) + " of "s + to_string(exhaustive_stats.scored_postings));
+}
+
+void TestPerformanceMaxScore(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+    for (const auto mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        SearchOptions options;
+        options.mode = mode;
+        LOG_DURATION(mode == EvaluationMode::MAX_SCORE ? "max score"s : "exhaustive"s);
+        double total_relevance = 0;
+        for (const string& query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+
+    const auto topical_dictionary = GenerateDictionary(generator, 3000, 10);
+    const auto texts = GenerateTopicalTexts(generator, topical_dictionary, 100'000, 100, 40, 10);
+    SearchServer topical_server(""s);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        topical_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    const auto topical_queries = GenerateTopicalTexts(generator, topical_dictionary, 100, 100, 10, 8);
+    for (const auto mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        SearchOptions options;
+        options.mode = mode;
+        LOG_DURATION(mode == EvaluationMode::MAX_SCORE ? "topical max score"s : "topical exhaustive"s);
+        double total_relevance = 0;
+        for (const string& query : topical_queries) {
+            for (const auto& document : topical_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+//Тест IDF после удаления документов
+void TestInverseDocumentFreqAfterRemove(){
+    const vector<string> texts = {
+        "funny pet and nasty rat"s,
+        "funny pet with curly hair"s,
+        "funny pet and not very nasty rat"s,
+        "pet with rat and rat and rat"s,
+        "nasty rat with curly hair"s,
+    };
+    SearchServer search_server("and with"s);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+    }
+    // после удаления всех документов со словом "curly" его список вхождений пуст
+    search_server.RemoveDocument(1);
+    search_server.RemoveDocument(execution::par, 4);
+    // IDF пересчитывается, когда удаления учтены шагом обслуживания
+    search_server.Maintain();
+
+    SearchServer expected_server("and with"s);
+    for (const int id : {0, 2, 3}) {
+        expected_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+    }
+    const string query = "curly nasty rat pet"s;
+    const auto found_docs = search_server.FindTopDocuments(query);
+    const auto expected_docs = expected_server.FindTopDocuments(query);
+    ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+    for (size_t i = 0; i < found_docs.size(); ++i) {
+        ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+        ASSERT(fabs(found_docs[i].relevance - expected_docs[i].relevance) < EPSILON);
+    }
+}
+
+//Тест декларативного фильтра документов
+void TestDocumentFilter(){
+    SearchServer search_server("and with"s);
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED};
+    for (int id = 0; id < 40; ++id) {
+        search_server.AddDocument(id, "white cat and "s + (id % 3 == 0 ? "curly dog"s : "fancy collar"s), statuses[id % 4], {id % 10});
+    }
+    search_server.RemoveDocument(8);
+    {
+        DocumentFilter filter;
+        filter.statuses = {DocumentStatus::BANNED};
+        const auto found_docs = search_server.FindTopDocuments("cat"s, filter);
+        ASSERT_EQUAL(found_docs.size(), 5u);
+        for (const Document& document : found_docs) {
+            ASSERT_EQUAL(document.id % 4, 2);
+        }
+    }
+
+    const auto check = [&search_server](const string& query, const DocumentFilter& filter, auto predicate) {
+        for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+            SearchOptions options;
+            options.top_k = 100;
+            options.mode = mode;
+            const auto found_docs = search_server.FindTopDocuments(query, filter, options);
+            const auto expected_docs = search_server.FindTopDocuments(query, predicate, options);
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                ASSERT(fabs(found_docs[i].relevance - expected_docs[i].relevance) < EPSILON);
+            }
+        }
+    };
+    // пустой фильтр допускает документы с любым статусом
+    check("curly cat"s, DocumentFilter{}, [](int, DocumentStatus, int) { return true; });
+
+    DocumentFilter filter;
+    filter.statuses = {DocumentStatus::ACTUAL, DocumentStatus::BANNED};
+    filter.min_rating = 2;
+    filter.max_rating = 7;
+    filter.id_ranges = {{0, 9}, {30, 35}};
+    const auto predicate = [](int id, DocumentStatus status, int rating) {
+        return (status == DocumentStatus::ACTUAL || status == DocumentStatus::BANNED)
+               && rating >= 2 && rating <= 7
+               && ((id >= 0 && id <= 9) || (id >= 30 && id <= 35));
+    };
+    check("curly dog cat"s, filter, predicate);
+    check("cat -curly"s, filter, predicate);
+    check("collar"s, filter, predicate);
+
+    // запрос со статусом идет через тот же фильтр
+    ASSERT_EQUAL(search_server.FindTopDocuments("collar"s, DocumentStatus::IRRELEVANT).size(),
+                 search_server.FindTopDocuments("collar"s, [](int, DocumentStatus status, int) { return status == DocumentStatus::IRRELEVANT; }).size());
+}
+
+//Тест кэша выдачи запросов
+void TestQueryResultCache(){
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(3, "big cat nasty hair"s, DocumentStatus::BANNED, {1, 2, 8});
+    // по умолчанию кэш выключен
+    search_server.FindTopDocuments("funny pet"s);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 0u);
+
+    search_server.EnableResultCache(1 << 20, 4);
+    const auto first = search_server.FindTopDocuments("funny nasty pet -hair"s);
+    // порядок и повторы слов не меняют нормализованный запрос
+    const auto second = search_server.FindTopDocuments("pet nasty -hair funny pet"s);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().hits, 1u);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 1u);
+    ASSERT_EQUAL(first.size(), second.size());
+    for (size_t i = 0; i < first.size(); ++i) {
+        ASSERT_EQUAL(first[i].id, second[i].id);
+    }
+    // другой статус и другое окно выдачи - другие ключи
+    ASSERT(search_server.FindTopDocuments("funny nasty pet -hair"s, DocumentStatus::BANNED).empty());
+    SearchOptions options;
+    options.top_k = 1;
+    ASSERT_EQUAL(search_server.FindTopDocuments("funny nasty pet -hair"s, DocumentStatus::ACTUAL, options).size(), 1u);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 3u);
+
+    // изменение индекса делает записи устаревшими
+    search_server.AddDocument(4, "funny nasty pet"s, DocumentStatus::ACTUAL, {3});
+    const auto after_add = search_server.FindTopDocuments("funny nasty pet -hair"s);
+    ASSERT_EQUAL(after_add.size(), 2u);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 4u);
+    search_server.RemoveDocument(4);
+    ASSERT_EQUAL(search_server.FindTopDocuments("funny nasty pet -hair"s).size(), 1u);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().hits, 1u);
+
+    // снимки делят кэш: новый снимок без изменений индекса сразу попадает в записи прежнего,
+    // а снимок после изменения не получает устаревшей выдачи
+    search_server.Maintain();
+    search_server.FindTopDocuments("funny nasty pet -hair"s);
+    SnapshotSearchServer snapshot_server(search_server);
+    ASSERT_EQUAL(snapshot_server.FindTopDocuments("funny nasty pet -hair"s).size(), 1u);
+    ASSERT_EQUAL(snapshot_server.GetSnapshot()->GetResultCacheStats().hits, 2u);
+    snapshot_server.Publish();
+    ASSERT_EQUAL(snapshot_server.FindTopDocuments("funny nasty pet -hair"s).size(), 1u);
+    ASSERT_EQUAL(snapshot_server.GetSnapshot()->GetResultCacheStats().hits, 3u);
+    const auto old_snapshot = snapshot_server.GetSnapshot();
+    snapshot_server.AddDocument(5, "funny nasty pet"s, DocumentStatus::ACTUAL, {3});
+    snapshot_server.Publish();
+    ASSERT_EQUAL(snapshot_server.FindTopDocuments("funny nasty pet -hair"s).size(), 2u);
+    ASSERT_EQUAL(snapshot_server.GetSnapshot()->GetResultCacheStats().hits, 3u);
+    // читатель старого снимка по-прежнему получает его выдачу
+    ASSERT_EQUAL(old_snapshot->FindTopDocuments("funny nasty pet -hair"s).size(), 1u);
+    ASSERT_EQUAL(snapshot_server.FindTopDocuments("funny nasty pet -hair"s).size(), 2u);
+    ASSERT_EQUAL(snapshot_server.GetSnapshot()->GetResultCacheStats().hits, 4u);
+
+    // параллельная обработка запросов дает ту же выдачу, что и без кэша
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 5000, 30);
+    SearchServer big_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        big_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    auto queries = GenerateQueries(generator, dictionary, 200, 5);
+    const vector<string> unique_queries = queries;
+    queries.insert(queries.end(), unique_queries.begin(), unique_queries.end());
+    const auto expected = ProcessQueries(big_server, queries);
+    // маленький кэш вытесняет записи раньше повторных запросов, большой вмещает все
+    for (const size_t max_bytes : {size_t{4 * 1024}, size_t{1 << 20}}) {
+        big_server.EnableResultCache(max_bytes, 8);
+        const auto cached = ProcessQueries(big_server, queries);
+        ASSERT_EQUAL(cached.size(), expected.size());
+        for (size_t i = 0; i < cached.size(); ++i) {
+            ASSERT_EQUAL(cached[i].size(), expected[i].size());
+            for (size_t j = 0; j < cached[i].size(); ++j) {
+                ASSERT_EQUAL(cached[i][j].id, expected[i][j].id);
+            }
+        }
+        const auto stats = big_server.GetResultCacheStats();
+        ASSERT_EQUAL(stats.hits + stats.misses, queries.size());
+        ASSERT(stats.bytes <= max_bytes);
+    }
+    ASSERT(big_server.GetResultCacheStats().hits > 0);
+}
+
+//Тест арены разбора запросов
+namespace {
+// считает выделения, которые арена запрашивает у upstream
+class CountingResource : public pmr::memory_resource {
+public:
+    size_t allocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+}
+
+void TestQueryArena(){
+    CountingResource counting;
+    {
+        QueryArena arena(&counting);
+        void* first = nullptr;
+        {
+            QueryArena::Scope scope(arena);
+            first = scope.GetResource()->allocate(100, 8);
+            {
+                // вложенная область не затирает память внешней
+                QueryArena::Scope inner(arena);
+                ASSERT(inner.GetResource()->allocate(100, 8) != first);
+                // запрос больше куска получает собственный кусок
+                ASSERT(inner.GetResource()->allocate(10000, 64) != nullptr);
+            }
+        }
+        QueryArena::Scope scope(arena);
+        ASSERT_EQUAL(scope.GetResource()->allocate(100, 8), first);
+        ASSERT_EQUAL(counting.allocations, 2u);
+    }
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 1000, 30);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 1 + i % 200, 0.2));
+    }
+
+    QueryArena& arena = QueryArena::ForThread();
+    arena.Reset(&counting);
+    counting.allocations = 0;
+    const auto run_queries = [&search_server, &queries]() {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            search_server.MatchDocument(queries[i], static_cast<int>(i));
+            search_server.MatchDocument(execution::par, queries[i], static_cast<int>(i));
+            search_server.FindTopDocuments(queries[i]);
+        }
+    };
+    run_queries();
+    const size_t warmup_allocations = counting.allocations;
+    ASSERT(warmup_allocations > 0);
+    // в установившемся режиме разбор запросов не обращается за новой памятью
+    for (int i = 0; i < 10; ++i) {
+        run_queries();
+    }
+    ASSERT_EQUAL(counting.allocations, warmup_allocations);
+    arena.Reset(pmr::new_delete_resource());
+}
+
+//Тест векторного токенизатора
+namespace {
+// прежнее деление на слова с отдельной проверкой символов
+vector<pair<string_view, bool>> SplitAndValidateByChar(string_view text) {
+    vector<pair<string_view, bool>> tokens;
+    while (!text.empty()) {
+        const auto space = text.find(' ');
+        const string_view word = text.substr(0, space);
+        const bool has_control_chars = any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
+        tokens.push_back({word, has_control_chars});
+        text.remove_prefix(min(text.find_first_not_of(' ', space), text.size()));
+    }
+    return tokens;
+}
+
+vector<pair<string_view, bool>> SplitAndValidate(string_view text) {
+    vector<pair<string_view, bool>> tokens;
+    ForEachToken(text, [&tokens](string_view word, bool has_control_chars) {
+        tokens.push_back({word, has_control_chars});
+    });
+    return tokens;
+}
+}
+
+void TestTokenizer(){
+    ASSERT(SplitAndValidate(""s).empty());
+    ASSERT_EQUAL(SplitAndValidate("   "s).size(), 1u);
+    const string sample = "белый кот\t  и x"s;
+    const auto tokens = SplitAndValidate(sample);
+    ASSERT_EQUAL(tokens.size(), 4u);
+    ASSERT_EQUAL(tokens[0].first, "белый"sv);
+    ASSERT(!tokens[0].second);
+    ASSERT_EQUAL(tokens[1].first, "кот\t"sv);
+    ASSERT(tokens[1].second);
+
+    // слова и управляющие символы на границах блоков по 64 байта
+    mt19937 generator;
+    const string alphabet = " \x01\x1f a-z\xd0\xba\x7f"s;
+    for (int length = 0; length < 300; ++length) {
+        for (int attempt = 0; attempt < 20; ++attempt) {
+            string text(length, 'a');
+            for (char& c : text) {
+                c = alphabet[uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+            }
+            const auto expected = SplitAndValidateByChar(text);
+            const auto actual = SplitAndValidate(text);
+            ASSERT_EQUAL_HINT(actual.size(), expected.size(), text);
+            for (size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(actual[i].first.data(), expected[i].first.data());
+                ASSERT_EQUAL(actual[i].first.size(), expected[i].first.size());
+                ASSERT_EQUAL(actual[i].second, expected[i].second);
+            }
+        }
+    }
+
+    SearchServer search_server("и в"s);
+    try {
+        search_server.AddDocument(1, "белый кот и модный ошейник                                                     пу\x12ш"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_HINT(false, "документ с управляющим символом должен отклоняться"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 0);
+}
+
+void TestPerformanceTokenizer(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10000, 25);
+    const auto documents = GenerateQueries(generator, dictionary, 100000, 100);
+    {
+        LOG_DURATION("split and validate by char"s);
+        size_t total = 0;
+        for (const string& document : documents) {
+            for (const auto& [word, has_control_chars] : SplitAndValidateByChar(document)) {
+                total += word.size() + has_control_chars;
+            }
+        }
+        cout << total << endl;
+    }
+    {
+        LOG_DURATION("fused tokenizer"s);
+        size_t total = 0;
+        for (const string& document : documents) {
+            ForEachToken(document, [&total](string_view word, bool has_control_chars) {
+                total += word.size() + has_control_chars;
+            });
+        }
+        cout << total << endl;
+    }
+}
+
+//Тест освобождения и уплотнения строк терминов
+void TestTermStorageReclaim(){
+    {
+        TermDictionary dictionary;
+        dictionary.Intern("cat"s);
+        dictionary.Intern("dog"s);
+        dictionary.Release(0);
+        ASSERT_EQUAL(dictionary.Find("cat"s), TermDictionary::NO_TERM);
+        // освобожденный идентификатор достается новому слову
+        ASSERT_EQUAL(dictionary.Intern("rat"s), 0u);
+        ASSERT_EQUAL(dictionary.GetTermCount(), 2u);
+        const TermDictionary copy = dictionary;
+        // перенос не копирует строки: выданные словарем string_view остаются действительными
+        const string_view dog = dictionary.GetTerm(1);
+        TermDictionary moved = std::move(dictionary);
+        ASSERT(moved.GetTerm(1).data() == dog.data());
+        ASSERT_EQUAL(moved.Find("rat"s), 0u);
+        dictionary = std::move(moved);
+        ASSERT(dictionary.GetTerm(1).data() == dog.data());
+        ASSERT_EQUAL(dictionary.GetArena().GetLiveBytes(), copy.GetArena().GetLiveBytes());
+        dictionary.Compact();
+        ASSERT_EQUAL(copy.GetTerm(0), "rat"s);
+        ASSERT_EQUAL(dictionary.Find("dog"s), 1u);
+    }
+
+    mt19937 generator;
+    const auto common_words = GenerateDictionary(generator, 100, 10);
+    SearchServer search_server("and with"s);
+    // каждый документ несет уникальные слова, которые исчезают вместе с ним
+    const auto make_document = [&common_words](int id) {
+        string text = common_words[id % common_words.size()] + " "s + common_words[(id * 7) % common_words.size()];
+        for (int i = 0; i < 20; ++i) {
+            text += " unique"s + to_string(id) + "x"s + to_string(i) + string(20, 'q');
+        }
+        return text;
+    };
+    const int window = 200;
+    size_t max_bytes = 0;
+    for (int id = 0; id < 5000; ++id) {
+        search_server.AddDocument(id, make_document(id), DocumentStatus::ACTUAL, {1});
+        if (id >= window) {
+            search_server.RemoveDocument(id - window);
+        }
+        // память возвращает шаг обслуживания, а не удаление
+        if (id % window == 0) {
+            search_server.Maintain();
+        }
+        if (id == 2 * window) {
+            max_bytes = search_server.GetTermStorageBytes();
+        }
+    }
+    // при постоянном числе живых документов память под строки не растет
+    ASSERT(search_server.GetTermStorageBytes() <= 2 * max_bytes);
+
+    SearchServer expected_server("and with"s);
+    for (int id = 5000 - window; id < 5000; ++id) {
+        expected_server.AddDocument(id, make_document(id), DocumentStatus::ACTUAL, {1});
+    }
+    search_server.Maintain();
+    search_server.CompactStorage();
+    for (const int id : {4800, 4850, 4999}) {
+        const string query = common_words[id % common_words.size()] + " unique"s + to_string(id) + "x3"s + string(20, 'q');
+        const auto [words, status] = search_server.MatchDocument(query, id);
+        const auto [expected_words, expected_status] = expected_server.MatchDocument(query, id);
+        ASSERT(words == expected_words);
+        const auto found_docs = search_server.FindTopDocuments(query);
+        const auto expected_docs = expected_server.FindTopDocuments(query);
+        ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+            ASSERT(fabs(found_docs[i].relevance - expected_docs[i].relevance) < EPSILON);
+        }
+        ASSERT(search_server.GetWordFrequencies(id) == expected_server.GetWordFrequencies(id));
+    }
+    // удаления и уплотнение списков не переносят строки: хранилище уплотняет только шаг обслуживания
+    for (int id = 5000; id < 6000; ++id) {
+        search_server.AddDocument(id, make_document(id), DocumentStatus::ACTUAL, {1});
+    }
+    const string query = "unique5950x3"s + string(20, 'q');
+    const string_view word = get<0>(search_server.MatchDocument(query, 5950)).at(0);
+    for (int id = 5000; id < 6000; ++id) {
+        if (id % 50 != 0) {
+            search_server.RemoveDocument(id);
+        }
+    }
+    search_server.CompactPostings();
+    ASSERT(get<0>(search_server.MatchDocument(query, 5950)).at(0).data() == word.data());
+    search_server.Maintain();
+    const string_view moved_word = get<0>(search_server.MatchDocument(query, 5950)).at(0);
+    ASSERT(moved_word.data() != word.data());
+    ASSERT_EQUAL(moved_word, query);
+}
+
+//Тест удаления пометкой и уплотнения списков вхождений
+void TestTombstoneDelete(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto documents = GenerateQueries(generator, dictionary, 2000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 4);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+    SearchServer expected_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (i % 3 != 0) {
+            expected_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+        }
+    }
+
+    const auto check = [&search_server, &expected_server, &queries]() {
+        for (const string& query : queries) {
+            for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+                SearchOptions options;
+                options.top_k = 50;
+                options.mode = mode;
+                const auto all = [](int, DocumentStatus, int) { return true; };
+                const auto found_docs = search_server.FindTopDocuments(query, all, options);
+                const auto expected_docs = expected_server.FindTopDocuments(query, all, options);
+                ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                    ASSERT(fabs(found_docs[i].relevance - expected_docs[i].relevance) < EPSILON);
+                }
+                ASSERT_EQUAL(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options).size(), expected_docs.size());
+            }
+        }
+    };
+
+    for (size_t i = 0; i < documents.size(); i += 3) {
+        if (i % 2 == 0) {
+            search_server.RemoveDocument(i);
+        } else {
+            search_server.RemoveDocument(execution::par, i);
+        }
+    }
+    // удаление только помечает документ: запросы его уже не видят, а статистика ждет обслуживания
+    ASSERT_EQUAL(search_server.GetPendingRemovalCount(), (documents.size() + 2) / 3);
+    ASSERT_EQUAL(search_server.GetDeadPostingCount(), 0u);
+    for (const string& query : queries) {
+        for (const Document& document : search_server.FindTopDocuments(query)) {
+            ASSERT(document.id % 3 != 0);
+        }
+    }
+    // вхождения удаленных документов остаются в списках до уплотнения
+    search_server.Maintain();
+    ASSERT_EQUAL(search_server.GetPendingRemovalCount(), 0u);
+    ASSERT(search_server.GetDeadPostingCount() > 0);
+    check();
+    search_server.CompactPostings();
+    ASSERT_EQUAL(search_server.GetDeadPostingCount(), 0u);
+    check();
+
+    // при массовом удалении уплотнение запускает шаг обслуживания, а не само удаление
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (i % 3 != 0) {
+            search_server.RemoveDocument(i);
+        }
+    }
+    ASSERT_EQUAL(search_server.GetDeadPostingCount(), 0u);
+    search_server.Maintain();
+    ASSERT(search_server.GetDeadPostingCount() < MIN_DEAD_POSTINGS_TO_COMPACT);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 0);
+    search_server.CompactPostings();
+    ASSERT(search_server.FindTopDocuments(queries[0]).empty());
+}
+
+//Тест пакетного добавления документов
+void TestAddDocuments(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3000, 25);
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.push_back({static_cast<int>(i) * 2, texts[i], static_cast<DocumentStatus>(i % 3), {static_cast<int>(i % 11), 4}});
+    }
+
+    SearchServer expected_server(dictionary[0]);
+    SearchServer search_server(dictionary[0]);
+    // пакет дополняет уже проиндексированные документы
+    expected_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    for (const NewDocument& document : batch) {
+        expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    search_server.AddDocuments(batch);
+
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+    for (const string& query : GenerateQueries(generator, dictionary, 30, 5)) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const auto found_docs = search_server.FindTopDocuments(query, status);
+            const auto expected_docs = expected_server.FindTopDocuments(query, status);
+            ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                ASSERT_EQUAL(found_docs[i].rating, expected_docs[i].rating);
+            }
+        }
+        const auto [words, status] = search_server.MatchDocument(query, 42);
+        const auto [expected_words, expected_status] = expected_server.MatchDocument(query, 42);
+        ASSERT(words == expected_words);
+        ASSERT(status == expected_status);
+    }
+    ASSERT(search_server.GetWordFrequencies(100) == expected_server.GetWordFrequencies(100));
+    search_server.RemoveDocument(100);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount() - 1);
+
+    // ошибка в любом документе пакета оставляет сервер без изменений
+    const auto check_rejected = [&search_server](const vector<NewDocument>& invalid_batch) {
+        const int document_count = search_server.GetDocumentCount();
+        try {
+            search_server.AddDocuments(invalid_batch);
+            ASSERT_HINT(false, "пакет с ошибкой должен отклоняться"s);
+        } catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(search_server.GetDocumentCount(), document_count);
+        ASSERT(search_server.FindTopDocuments("zebra"s).empty());
+    };
+    vector<NewDocument> invalid_batch;
+    for (int i = 0; i < 1000; ++i) {
+        invalid_batch.push_back({100000 + i, "zebra"sv, DocumentStatus::ACTUAL, {1}});
+    }
+    invalid_batch[700].text = "zeb\x03ra"sv;
+    check_rejected(invalid_batch);
+    invalid_batch[700].text = "zebra"sv;
+    invalid_batch[900].id = 100001;
+    check_rejected(invalid_batch);
+    invalid_batch[900].id = 2;
+    check_rejected(invalid_batch);
+    invalid_batch[900].id = -5;
+    check_rejected(invalid_batch);
+}
+
+void TestPerformanceAddDocuments(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 50000, 100);
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+    }
+    {
+        LOG_DURATION("AddDocument"s);
+        SearchServer search_server(dictionary[0]);
+        for (const NewDocument& document : batch) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        cout << search_server.GetDocumentCount() << endl;
+    }
+    {
+        LOG_DURATION("AddDocuments"s);
+        SearchServer search_server(dictionary[0]);
+        search_server.AddDocuments(batch);
+        cout << search_server.GetDocumentCount() << endl;
+    }
+}
+
+//Тест индекса из сегментов
+void TestSegmentedIndex(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 400, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 30, 5);
+    SearchServer search_server(dictionary[0]);
+    search_server.SetRefreshInterval(50);
+    // весь индекс в одном изменяемом сегменте
+    SearchServer expected_server(dictionary[0]);
+    expected_server.SetRefreshInterval(0);
+
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int rating = static_cast<int>(i % 9);
+        if (i < 2000) {
+            search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {rating});
+        } else {
+            batch.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {rating}});
+        }
+        expected_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {rating});
+    }
+    search_server.AddDocuments(batch);
+    ASSERT_EQUAL(expected_server.GetSegmentCount(), 0u);
+    // ярусное слияние держит число сегментов логарифмическим
+    ASSERT(search_server.GetSegmentCount() > 1);
+    ASSERT(search_server.GetSegmentCount() < 12);
+
+    const auto check = [&search_server, &expected_server, &queries]() {
+        for (const string& query : queries) {
+            for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+                SearchOptions options;
+                options.top_k = 20;
+                options.mode = mode;
+                const auto found_docs = search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, options);
+                const auto expected_docs = expected_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+                ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                    ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                }
+            }
+            const auto even = [](int id, DocumentStatus, int) { return id % 2 == 0; };
+            ASSERT_EQUAL(search_server.FindTopDocuments(query, even).size(), expected_server.FindTopDocuments(query, even).size());
+        }
+    };
+    check();
+    // удаления в замороженных и изменяемом сегментах
+    for (int id = 0; id < 3000; id += 7) {
+        search_server.RemoveDocument(id);
+        expected_server.RemoveDocument(id);
+    }
+    check();
+    search_server.CompactPostings();
+    expected_server.Maintain();
+    check();
+    search_server.Refresh();
+    check();
+
+    // слияния на пути записи ограничены: слияние четырех сегментов по 64 интервала
+    // заморозки откладывается, и его доделывает шаг обслуживания
+    SearchServer capped_server(dictionary[0]);
+    capped_server.SetRefreshInterval(10);
+    for (int id = 0; id < 2560; ++id) {
+        capped_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+    }
+    ASSERT(capped_server.GetSegmentCount() >= SEGMENT_MERGE_FACTOR);
+    const auto before_maintain = capped_server.FindTopDocuments(queries[0]);
+    capped_server.Maintain();
+    ASSERT_EQUAL(capped_server.GetSegmentCount(), 1u);
+    const auto after_maintain = capped_server.FindTopDocuments(queries[0]);
+    ASSERT_EQUAL(after_maintain.size(), before_maintain.size());
+    for (size_t i = 0; i < after_maintain.size(); ++i) {
+        ASSERT_EQUAL(after_maintain[i].id, before_maintain[i].id);
+    }
+}
+
+void TestPerformanceRefresh(){
+    mt19937 generator;
+    // большой словарь: каждый документ приносит свои слова
+    SearchServer search_server(""s);
+    for (int id = 0; id < 20'000; ++id) {
+        string text;
+        for (int i = 0; i < 10; ++i) {
+            text += "word"s + to_string(id * 10 + i) + " "s;
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+    const auto dictionary = GenerateDictionary(generator, 100, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 5000, 10);
+    search_server.SetRefreshInterval(10);
+    {
+        LOG_DURATION("frequent refresh over a large dictionary"s);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(100'000 + i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments(dictionary[1]).size(), 5u);
+}
+
+//Тест сжатых сегментов
+void TestCompressedSegments(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 4000, 30);
+    vector<string> queries;
+    for (int i = 0; i < 40; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 5, 0.2));
+    }
+    SearchServer search_server(dictionary[0]);
+    search_server.SetRefreshInterval(300);
+    SearchServer expected_server(dictionary[0]);
+    for (int id = 0; id < 3000; ++id) {
+        search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), {id % 7});
+        expected_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), {id % 7});
+    }
+    const size_t raw_bytes = search_server.GetPostingStorageBytes();
+    search_server.SetPostingCompression(true);
+    ASSERT(2 * search_server.GetPostingStorageBytes() < raw_bytes);
+
+    // сжатие без потерь: выдача совпадает вплоть до релевантности
+    const auto check = [&queries, &expected_server](const SearchServer& server) {
+        for (const string& query : queries) {
+            for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+                SearchOptions options;
+                options.top_k = 20;
+                options.mode = mode;
+                const auto found_docs = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, options);
+                const auto expected_docs = expected_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+                ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                    ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                }
+            }
+        }
+        const auto found_batch = server.FindTopDocumentsBatch(queries, DocumentStatus::IRRELEVANT, SearchOptions{});
+        const auto expected_batch = expected_server.FindTopDocumentsBatch(queries, DocumentStatus::IRRELEVANT, SearchOptions{});
+        for (size_t i = 0; i < queries.size(); ++i) {
+            ASSERT_EQUAL_HINT(found_batch[i].size(), expected_batch[i].size(), queries[i]);
+            for (size_t j = 0; j < found_batch[i].size(); ++j) {
+                ASSERT_EQUAL(found_batch[i][j].id, expected_batch[i][j].id);
+            }
+        }
+    };
+    check(search_server);
+    // новые сегменты, слияния и уплотнение тоже дают сжатые сегменты
+    for (int id = 3000; id < 4000; ++id) {
+        search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), {id % 7});
+        expected_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), {id % 7});
+    }
+    check(search_server);
+    for (int id = 0; id < 4000; id += 7) {
+        search_server.RemoveDocument(id);
+        expected_server.RemoveDocument(id);
+    }
+    check(search_server);
+    search_server.CompactPostings();
+    expected_server.Maintain();
+    check(search_server);
+
+    // в файл сегменты пишутся распакованными
+    const string path = (filesystem::temp_directory_path() / "search_server_compressed.idx"s).string();
+    search_server.Save(path);
+    {
+        const SearchServer loaded_server = SearchServer::Load(path);
+        check(loaded_server);
+    }
+    filesystem::remove(path);
+    const size_t compressed_bytes = search_server.GetPostingStorageBytes();
+    search_server.SetPostingCompression(false);
+    ASSERT(search_server.GetPostingStorageBytes() > 2 * compressed_bytes);
+    check(search_server);
+}
+
+void TestPerformanceCompressedSegments(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 2'000, 7);
+
+    // сегмент из тех же текстов: распаковка всех списков против чтения плоских массивов
+    map<string_view, uint32_t> term_ids;
+    for (const string& word : dictionary) {
+        term_ids.emplace(word, static_cast<uint32_t>(term_ids.size()));
+    }
+    vector<map<uint32_t, int>> term_counts(texts.size());
+    for (size_t slot = 0; slot < texts.size(); ++slot) {
+        for (const string_view word : SplitIntoWordsStringView(texts[slot])) {
+            ++term_counts[slot][term_ids.at(word)];
+        }
+    }
+    vector<vector<pair<uint32_t, float>>> postings(term_ids.size());
+    for (size_t slot = 0; slot < texts.size(); ++slot) {
+        for (const auto& [term_id, count] : term_counts[slot]) {
+            postings[term_id].emplace_back(static_cast<uint32_t>(slot), static_cast<float>(count) / 70);
+        }
+    }
+    IndexSegment raw_segment(0, static_cast<uint32_t>(texts.size()));
+    for (uint32_t term_id = 0; term_id < postings.size(); ++term_id) {
+        raw_segment.BeginTerm(term_id);
+        for (const auto& [slot, term_freq] : postings[term_id]) {
+            raw_segment.AddPosting(slot, term_freq);
+        }
+        raw_segment.EndTerm();
+    }
+    IndexSegment compressed_segment = raw_segment;
+    compressed_segment.Compress();
+    cout << "posting bytes: raw "s << raw_segment.GetPostingBytes() << ", compressed "s << compressed_segment.GetPostingBytes() << endl;
+
+    const auto scan = [&postings](string_view mark, const IndexSegment& segment) {
+        LOG_DURATION(mark);
+        double total = 0;
+        for (int pass = 0; pass < 50; ++pass) {
+            for (uint32_t term_id = 0; term_id < postings.size(); ++term_id) {
+                const QueryArena::Scope scope;
+                const PostingSpan span = segment.GetPostings(term_id, scope.GetResource());
+                for (size_t i = 0; i < span.size(); ++i) {
+                    total += span.GetSlots()[i] * span.GetTermFreqs()[i];
+                }
+            }
+        }
+        cout << total << endl;
+        return total;
+    };
+    const double raw_total = scan("float SoA scan"s, raw_segment);
+    const double compressed_total = scan("StreamVByte decode and scan"s, compressed_segment);
+    ASSERT_EQUAL(raw_total, compressed_total);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t id = 0; id < texts.size(); ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+    }
+    search_server.Refresh();
+    Test("queries over raw segments"s, search_server, queries, execution::seq);
+    search_server.SetPostingCompression(true);
+    Test("queries over compressed segments"s, search_server, queries, execution::seq);
+}
+
+//Тест чтения снимков индекса во время записи
+void TestSnapshotSearchServer(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 4000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 50, 4);
+    SearchServer initial_server(dictionary[0]);
+    for (int id = 0; id < 1000; ++id) {
+        initial_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 7});
+    }
+    SnapshotSearchServer search_server(std::move(initial_server));
+    ASSERT_EQUAL(search_server.GetVersion(), 1u);
+
+    // изменения не видны до публикации, а взятый снимок не меняется и после нее
+    const auto same_results = [](const vector<vector<Document>>& lhs, const vector<vector<Document>>& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (lhs[i].size() != rhs[i].size()) {
+                return false;
+            }
+            for (size_t j = 0; j < lhs[i].size(); ++j) {
+                if (lhs[i][j].id != rhs[i][j].id || lhs[i][j].relevance != rhs[i][j].relevance) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    const auto snapshot = search_server.GetSnapshot();
+    const auto expected_results = ProcessQueries(*snapshot, queries);
+    for (int id = 1000; id < 1500; ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 7});
+    }
+    for (int id = 0; id < 1000; id += 3) {
+        search_server.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 1000);
+    search_server.Publish();
+    search_server.CompactPostings();
+    search_server.Publish();
+    ASSERT_EQUAL(search_server.GetVersion(), 3u);
+    ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 1500 - 334);
+    ASSERT_EQUAL(snapshot->GetDocumentCount(), 1000);
+    ASSERT(same_results(ProcessQueries(*snapshot, queries), expected_results));
+    // таблица документов, словарь и прямой индекс общие со снимком, но его не меняют
+    ASSERT_EQUAL(snapshot->GetDocumentId(0), 0);
+    ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentId(0), 1);
+    ASSERT(!snapshot->GetWordFrequencies(0).empty());
+    ASSERT(search_server.GetSnapshot()->GetWordFrequencies(0).empty());
+    ASSERT(snapshot->GetWordFrequencies(1200).empty());
+
+    // читатели ищут, пока писатель добавляет документы и публикует версии;
+    // число документов в снимках, которые видит читатель, не убывает
+    atomic<bool> writing = true;
+    const auto reader = [&search_server, &queries, &writing, &same_results]() {
+        int last_count = 0;
+        size_t snapshot_count = 0;
+        do {
+            const auto current = search_server.GetSnapshot();
+            ASSERT(current->GetDocumentCount() >= last_count);
+            last_count = current->GetDocumentCount();
+            const auto found = ProcessQueries(*current, queries);
+            ASSERT(same_results(found, ProcessQueries(*current, queries)));
+            ++snapshot_count;
+        } while (writing);
+        return snapshot_count;
+    };
+    auto first_reader = async(launch::async, reader);
+    auto second_reader = async(launch::async, reader);
+    for (int id = 1500; id < 4000; id += 100) {
+        vector<NewDocument> batch;
+        for (int i = id; i < id + 100; ++i) {
+            batch.push_back({i, texts[i], DocumentStatus::ACTUAL, {i % 7}});
+        }
+        search_server.AddDocuments(batch);
+        search_server.RemoveDocument(id - 1);
+        search_server.Publish();
+    }
+    writing = false;
+    ASSERT(first_reader.get() > 0);
+    ASSERT(second_reader.get() > 0);
+    ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 4000 - 334 - 25);
+    ASSERT(same_results(search_server.ProcessQueries(queries), ProcessQueries(*search_server.GetSnapshot(), queries)));
+}
+
+void TestPerformancePublish(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 200'200, 10);
+    vector<NewDocument> batch;
+    for (int id = 0; id < 200'000; ++id) {
+        batch.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 7}});
+    }
+    SearchServer initial_server(""s);
+    initial_server.AddDocuments(batch);
+    SnapshotSearchServer search_server(std::move(initial_server));
+    {
+        LOG_DURATION("publish after each change"s);
+        for (int id = 200'000; id < 200'200; ++id) {
+            search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 7});
+            search_server.RemoveDocument(id - 200'000);
+            search_server.Publish();
+        }
+    }
+    ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 200'000);
+}
+
+//Тест сохранения и загрузки индекса
+void TestSaveLoad(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 400, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 30, 5);
+    SearchServer search_server(dictionary[0] + " "s + dictionary[1]);
+    search_server.SetRefreshInterval(500);
+    for (int id = 0; id < 2300; ++id) {
+        search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 5, 3});
+    }
+    for (int id = 0; id < 2300; id += 11) {
+        search_server.RemoveDocument(id);
+    }
+    const string path = (filesystem::temp_directory_path() / "search_server_test.idx"s).string();
+    search_server.Save(path);
+
+    const auto check = [&queries](const SearchServer& loaded_server, const SearchServer& expected_server) {
+        ASSERT_EQUAL(loaded_server.GetDocumentCount(), expected_server.GetDocumentCount());
+        for (int index = 0; index < expected_server.GetDocumentCount(); index += 97) {
+            ASSERT_EQUAL(loaded_server.GetDocumentId(index), expected_server.GetDocumentId(index));
+        }
+        for (const string& query : queries) {
+            for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+                SearchOptions options;
+                options.top_k = 20;
+                options.mode = mode;
+                const auto found_docs = loaded_server.FindTopDocuments(query, DocumentStatus::BANNED, options);
+                const auto expected_docs = expected_server.FindTopDocuments(query, DocumentStatus::BANNED, options);
+                ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                    ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                    ASSERT_EQUAL(found_docs[i].rating, expected_docs[i].rating);
+                }
+            }
+            const auto [words, status] = loaded_server.MatchDocument(query, 100);
+            const auto [expected_words, expected_status] = expected_server.MatchDocument(query, 100);
+            ASSERT(words == expected_words);
+            ASSERT(status == expected_status);
+        }
+        ASSERT(loaded_server.GetWordFrequencies(7) == expected_server.GetWordFrequencies(7));
+    };
+    for (const LoadOptions& options : {LoadOptions{}, LoadOptions{true, true}}) {
+        check(SearchServer::Load(path, options), search_server);
+    }
+
+    // загруженный сервер принимает изменения наравне с исходным
+    SearchServer loaded_server = SearchServer::Load(path);
+    for (int id = 2300; id < 3000; ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::BANNED, {id % 5});
+        loaded_server.AddDocument(id, texts[id], DocumentStatus::BANNED, {id % 5});
+    }
+    for (int id = 1; id < 3000; id += 4) {
+        if (id < 2300 && id % 11 == 0) {
+            continue;
+        }
+        search_server.RemoveDocument(id);
+        loaded_server.RemoveDocument(id);
+    }
+    search_server.CompactPostings();
+    loaded_server.CompactPostings();
+    check(loaded_server, search_server);
+
+    const auto check_rejected = [&path](const LoadOptions& options) {
+        try {
+            SearchServer::Load(path, options);
+            ASSERT_HINT(false, "поврежденный файл должен отклоняться"s);
+        } catch (const runtime_error&) {
+        }
+    };
+    search_server.Save(path);
+    string bytes;
+    {
+        ifstream in(path, ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    const auto write_file = [&path](const string& content) {
+        ofstream out(path, ios::binary | ios::trunc);
+        out << content;
+    };
+    // последние 8 байт перед таблицей секций принадлежат последнему сегменту:
+    // его порча видна только при сверке контрольных сумм сегментов
+    uint64_t table_offset = 0;
+    memcpy(&table_offset, bytes.data() + 16, sizeof(table_offset));
+    string corrupted = bytes;
+    corrupted[table_offset - 8] ^= 1;
+    write_file(corrupted);
+    check_rejected(LoadOptions{true, false});
+    SearchServer::Load(path);
+    // слот за границей сегмента отклоняется и без сверки контрольных сумм:
+    // идем по массивам последнего сегмента до массива слотов
+    uint64_t section_count = 0;
+    memcpy(&section_count, bytes.data() + 24, sizeof(section_count));
+    uint64_t position = 0;
+    memcpy(&position, bytes.data() + table_offset + (section_count - 1) * 32 + 8, sizeof(position));
+    position += 16;
+    for (const size_t element_size : {sizeof(uint32_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(float)}) {
+        uint64_t size = 0;
+        memcpy(&size, bytes.data() + position, sizeof(size));
+        position += 8 + (size * element_size + 7) / 8 * 8;
+    }
+    corrupted = bytes;
+    const uint32_t broken_slot = numeric_limits<uint32_t>::max();
+    memcpy(corrupted.data() + position + 8, &broken_slot, sizeof(broken_slot));
+    write_file(corrupted);
+    check_rejected(LoadOptions{});
+    // порча служебной секции видна всегда
+    corrupted = bytes;
+    corrupted[4096 + 100] ^= 1;
+    write_file(corrupted);
+    check_rejected(LoadOptions{});
+    write_file(bytes.substr(0, bytes.size() - 1));
+    check_rejected(LoadOptions{});
+    write_file("white cat"s);
+    check_rejected(LoadOptions{});
+    filesystem::remove(path);
+    check_rejected(LoadOptions{});
+}
+
+void TestPerformanceLoad(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 50000, 100);
+    const auto queries = GenerateQueries(generator, dictionary, 1000, 7);
+    const string path = (filesystem::temp_directory_path() / "search_server_perf.idx"s).string();
+    double total_relevance = 0;
+    {
+        LOG_DURATION("rebuild"s);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        for (const string& query : queries) {
+            for (const Document& document : search_server.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        search_server.Save(path);
+    }
+    cout << total_relevance << endl;
+    total_relevance = 0;
+    {
+        LOG_DURATION("load"s);
+        const SearchServer search_server = SearchServer::Load(path);
+        for (const string& query : queries) {
+            for (const Document& document : search_server.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+    }
+    cout << total_relevance << endl;
+    filesystem::remove(path);
+}
+
+//Тест журнала упреждающей записи и восстановления после сбоя
+void TestDurableSearchServer(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 1000, 15);
+    const auto queries = GenerateQueries(generator, dictionary, 30, 4);
+    const string directory = (filesystem::temp_directory_path() / "search_server_wal_test"s).string();
+    filesystem::remove_all(directory);
+    WriteAheadLogOptions options;
+    options.sync_batch_records = 16;
+
+    SearchServer expected_server(dictionary[0]);
+    const auto check = [&expected_server, &queries](const SearchServer& search_server) {
+        ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+        for (const string& query : queries) {
+            const auto found_docs = search_server.FindTopDocuments(query);
+            const auto expected_docs = expected_server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                ASSERT_EQUAL(found_docs[i].rating, expected_docs[i].rating);
+            }
+        }
+    };
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        ASSERT_EQUAL(search_server.GetReplayedRecordCount(), 0u);
+        for (int id = 0; id < 400; ++id) {
+            search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 5});
+            expected_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id % 5});
+        }
+        search_server.Checkpoint();
+        for (int id = 0; id < 400; id += 3) {
+            search_server.RemoveDocument(id);
+            expected_server.RemoveDocument(id);
+        }
+        vector<NewDocument> batch;
+        for (int id = 400; id < 600; ++id) {
+            batch.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 5}});
+        }
+        search_server.AddDocuments(batch);
+        expected_server.AddDocuments(batch);
+        // ошибочная операция не попадает в журнал
+        try {
+            search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+            ASSERT_HINT(false, "повторный id должен отклоняться"s);
+        } catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(search_server.GetLastSequence(), 400u + 134u + 200u);
+        check(search_server.GetServer());
+    }
+
+    // после снимка применяется только хвост журнала
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        ASSERT_EQUAL(search_server.GetReplayedRecordCount(), 134u + 200u);
+        ASSERT_EQUAL(search_server.GetLastSequence(), 400u + 134u + 200u);
+        check(search_server.GetServer());
+    }
+
+    // недописанная при сбое запись отбрасывается, а журнал продолжается после последней целой
+    const auto list_files = [&directory](const string& extension) {
+        vector<string> paths;
+        for (const auto& entry : filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == extension) {
+                paths.push_back(entry.path().string());
+            }
+        }
+        sort(paths.begin(), paths.end());
+        return paths;
+    };
+    // журнал до первого снимка остается, пока снимок не станет предыдущим
+    const vector<string> logs = list_files(".log"s);
+    ASSERT_EQUAL(logs.size(), 2u);
+    {
+        ofstream out(logs.back(), ios::binary | ios::app);
+        out << "\x10\x20\x30 torn record"s;
+    }
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        check(search_server.GetServer());
+        for (int id = 600; id < 700; ++id) {
+            search_server.AddDocument(id, texts[id], DocumentStatus::BANNED, {id % 5});
+            expected_server.AddDocument(id, texts[id], DocumentStatus::BANNED, {id % 5});
+        }
+        search_server.RemoveDocument(401);
+        expected_server.RemoveDocument(401);
+    }
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        check(search_server.GetServer());
+        ASSERT_EQUAL(search_server.GetServer().FindTopDocuments(texts[650], DocumentStatus::BANNED).size(), 5u);
+        search_server.Checkpoint();
+    }
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        ASSERT_EQUAL(search_server.GetReplayedRecordCount(), 0u);
+        check(search_server.GetServer());
+    }
+    ASSERT_EQUAL(list_files(".idx"s).size(), 2u);
+    ASSERT_EQUAL(list_files(".log"s).size(), 2u);
+
+    // порча последнего снимка видна только при сверке сегментов: сервер восстанавливается
+    // из предыдущего снимка и журналов после него
+    const string newest_snapshot = list_files(".idx"s).back();
+    string bytes;
+    {
+        ifstream in(newest_snapshot, ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    uint64_t table_offset = 0;
+    memcpy(&table_offset, bytes.data() + 16, sizeof(table_offset));
+    bytes[table_offset - 8] ^= 1;
+    {
+        ofstream out(newest_snapshot, ios::binary | ios::trunc);
+        out << bytes;
+    }
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        ASSERT_EQUAL(search_server.GetReplayedRecordCount(), 134u + 200u + 100u + 1u);
+        check(search_server.GetServer());
+        search_server.AddDocument(700, texts[700], DocumentStatus::ACTUAL, {1});
+        expected_server.AddDocument(700, texts[700], DocumentStatus::ACTUAL, {1});
+        // испорченный снимок не становится предыдущим
+        search_server.Checkpoint();
+    }
+    ASSERT_EQUAL(list_files(".idx"s).size(), 2u);
+    {
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        ASSERT_EQUAL(search_server.GetReplayedRecordCount(), 0u);
+        check(search_server.GetServer());
+        // снимок без новых записей не переписывается
+        const auto snapshot_time = filesystem::last_write_time(list_files(".idx"s).back());
+        search_server.Checkpoint();
+        ASSERT(list_files(".idx"s).size() == 2u && filesystem::last_write_time(list_files(".idx"s).back()) == snapshot_time);
+    }
+    filesystem::remove_all(directory);
+
+    // при редких записях пакет уходит в файл по сроку, не дожидаясь Sync и новых записей
+    filesystem::create_directories(directory);
+    const string log_path = (filesystem::path(directory) / "wal.log"s).string();
+    WriteAheadLogOptions delay_options;
+    delay_options.sync_batch_records = 0;
+    delay_options.sync_max_delay = chrono::milliseconds(5);
+    {
+        WriteAheadLog log(log_path, 1, 0, delay_options);
+        log.AppendRemove(7);
+        this_thread::sleep_for(chrono::milliseconds(200));
+        const auto result = WriteAheadLog::Replay(log_path, 1, 0, [](const LogRecord& record) { ASSERT_EQUAL(record.document_id, 7); });
+        ASSERT_EQUAL(result.last_sequence, 1u);
+    }
+    filesystem::remove_all(directory);
+}
+
+void TestPerformanceWriteAheadLog(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 5000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 5000, 50);
+    const string directory = (filesystem::temp_directory_path() / "search_server_wal_perf"s).string();
+    for (const size_t batch_records : {size_t{1}, size_t{256}}) {
+        filesystem::remove_all(directory);
+        WriteAheadLogOptions options;
+        options.sync_batch_records = batch_records;
+        LOG_DURATION("fsync every "s + to_string(batch_records) + " records"s);
+        DurableSearchServer search_server(directory, dictionary[0], options);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        search_server.Sync();
+        cout << search_server.GetServer().GetDocumentCount() << endl;
+    }
+    {
+        LOG_DURATION("replay"s);
+        DurableSearchServer search_server(directory, dictionary[0]);
+        cout << search_server.GetReplayedRecordCount() << endl;
+    }
+    filesystem::remove_all(directory);
+}
+
+//Тест загрузки корпуса из файла
+void TestLoadCorpus(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 2000, 15);
+    const auto queries = GenerateQueries(generator, dictionary, 30, 4);
+    const string path = (filesystem::temp_directory_path() / "search_server_corpus.tsv"s).string();
+    const string status_names[] = {"ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s};
+
+    SearchServer expected_server(dictionary[0]);
+    string corpus;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int id = static_cast<int>(i) * 3;
+        const auto status = static_cast<DocumentStatus>(i % 4);
+        vector<int> ratings;
+        for (size_t j = 0; j < i % 4; ++j) {
+            ratings.push_back(static_cast<int>(i % 7) - static_cast<int>(j));
+        }
+        expected_server.AddDocument(id, texts[i], status, ratings);
+        // статус то числом, то именем; рейтинги могут отсутствовать, строки - кончаться на \r\n
+        corpus += to_string(id) + "\t"s + (i % 2 == 0 ? to_string(static_cast<int>(status)) : status_names[i % 4]) + "\t"s;
+        for (size_t j = 0; j < ratings.size(); ++j) {
+            corpus += (j > 0 ? " "s : ""s) + to_string(ratings[j]);
+        }
+        corpus += "\t"s + texts[i] + (i % 5 == 0 ? "\r\n"s : "\n"s);
+        if (i % 100 == 0) {
+            corpus += "\n"s;
+        }
+    }
+    corpus.pop_back();
+    const auto write_file = [&path](const string& content) {
+        ofstream out(path, ios::binary | ios::trunc);
+        out << content;
+    };
+    write_file(corpus);
+
+    // мелкие куски: границы попадают внутрь строк
+    for (const size_t chunk_bytes : {size_t{1}, size_t{777}, CORPUS_CHUNK_BYTES}) {
+        SearchServer search_server(dictionary[0]);
+        ASSERT_EQUAL(LoadCorpus(search_server, path, chunk_bytes), texts.size());
+        ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+        for (const string& query : queries) {
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::REMOVED}) {
+                const auto found_docs = search_server.FindTopDocuments(query, status);
+                const auto expected_docs = expected_server.FindTopDocuments(query, status);
+                ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < found_docs.size(); ++i) {
+                    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+                    ASSERT_EQUAL(found_docs[i].relevance, expected_docs[i].relevance);
+                    ASSERT_EQUAL(found_docs[i].rating, expected_docs[i].rating);
+                }
+            }
+        }
+    }
+
+    for (const string& bad_line : {"12\tACTUAL\t1 2\n"s, "x\t0\t1\tcat\n"s, "12\t7\t1\tcat\n"s, "12\t0\t1 y\tcat\n"s, "12\t0\t1\tc\x01t\n"s}) {
+        write_file("5\t0\t1\twhite cat\n"s + bad_line);
+        SearchServer search_server(dictionary[0]);
+        try {
+            LoadCorpus(search_server, path);
+            ASSERT_HINT(false, "неверная строка должна отклоняться: "s + bad_line);
+        } catch (const invalid_argument&) {
+        }
+    }
+    filesystem::remove(path);
+}
+
+void TestPerformanceLoadCorpus(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 50000, 100);
+    const string path = (filesystem::temp_directory_path() / "search_server_corpus_perf.tsv"s).string();
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            out << i << "\t0\t1 2 3\t"s << texts[i] << "\n"s;
+        }
+    }
+    {
+        LOG_DURATION("getline and AddDocument"s);
+        SearchServer search_server(dictionary[0]);
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            istringstream fields(line);
+            int id;
+            int status;
+            string ratings_text;
+            string text;
+            fields >> id >> status;
+            fields.ignore();
+            getline(fields, ratings_text, '\t');
+            getline(fields, text);
+            istringstream ratings_stream(ratings_text);
+            vector<int> ratings;
+            for (int rating; ratings_stream >> rating;) {
+                ratings.push_back(rating);
+            }
+            search_server.AddDocument(id, text, static_cast<DocumentStatus>(status), ratings);
+        }
+        cout << search_server.GetDocumentCount() << endl;
+    }
+    {
+        LOG_DURATION("LoadCorpus"s);
+        SearchServer search_server(dictionary[0]);
+        LoadCorpus(search_server, path);
+        cout << search_server.GetDocumentCount() << endl;
+    }
+    filesystem::remove(path);
+}
+
+//Тест пакетного выполнения запросов
+void TestFindTopDocumentsBatch(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 6000, 20);
+    auto queries = GenerateQueries(generator, dictionary, 60, 4);
+    // минус-слова и повторы запросов
+    for (size_t i = 0; i < 20; ++i) {
+        queries.push_back(queries[i] + " -"s + dictionary[(i * 13) % dictionary.size()]);
+    }
+    queries.push_back(queries[0]);
+    queries.push_back(""s);
+    SearchServer search_server(dictionary[0]);
+    search_server.SetRefreshInterval(500);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const auto status = static_cast<DocumentStatus>(i % 3 == 0 ? 1 : 0);
+        search_server.AddDocument(i, texts[i], status, {static_cast<int>(i % 11) - 5});
+    }
+    // удаления в замороженных и изменяемом сегментах
+    for (int id = 0; id < 6000; id += 17) {
+        search_server.RemoveDocument(id);
+    }
+    ASSERT(search_server.GetSegmentCount() > 0);
+
+    const auto check = [&search_server, &queries](DocumentStatus status, const SearchOptions& options) {
+        const auto results = search_server.FindTopDocumentsBatch(queries, status, options);
+        ASSERT_EQUAL(results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const auto expected_docs = search_server.FindTopDocuments(queries[i], status, options);
+            ASSERT_EQUAL_HINT(results[i].size(), expected_docs.size(), queries[i]);
+            for (size_t j = 0; j < expected_docs.size(); ++j) {
+                ASSERT_EQUAL(results[i][j].id, expected_docs[j].id);
+                ASSERT_EQUAL(results[i][j].relevance, expected_docs[j].relevance);
+                ASSERT_EQUAL(results[i][j].rating, expected_docs[j].rating);
+            }
+        }
+    };
+    check(DocumentStatus::ACTUAL, {});
+    check(DocumentStatus::IRRELEVANT, {});
+    SearchOptions options;
+    options.top_k = 30;
+    options.offset = 10;
+    check(DocumentStatus::ACTUAL, options);
+    search_server.CompactPostings();
+    check(DocumentStatus::ACTUAL, {});
+
+    // редкие слова: у блока вхождения лишь в немногих плитках, остальные пропускаются
+    const vector<string> dense_queries = queries;
+    for (size_t i = 0; i < 40; ++i) {
+        const string rare_word = "rare"s + to_string(i);
+        search_server.AddDocument(6000 + i, texts[i] + " "s + rare_word, DocumentStatus::ACTUAL, {1});
+        search_server.AddDocument(7000 + i, rare_word + " "s + rare_word, DocumentStatus::ACTUAL, {2});
+        queries.push_back(rare_word + " "s + dictionary[i]);
+        queries.push_back(rare_word + " rare"s + to_string(39 - i) + " -"s + dictionary[i]);
+    }
+    check(DocumentStatus::ACTUAL, {});
+    check(DocumentStatus::ACTUAL, options);
+    queries = dense_queries;
+
+    const auto batched = ProcessQueriesBatched(search_server, queries);
+    const auto expected = ProcessQueries(search_server, queries);
+    ASSERT_EQUAL(batched.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(batched[i].size(), expected[i].size());
+    }
+
+    // ошибка разбора любого запроса отменяет весь пакет
+    try {
+        search_server.FindTopDocumentsBatch({queries[0], "cat --dog"s});
+        ASSERT_HINT(false, "Ожидалось исключение для неверного запроса"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestPerformanceBatchQueries(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 20000, 100);
+    // у пакета запросов пересекаются слова: тематические запросы из небольшого словаря
+    const vector<string> topic(dictionary.begin(), dictionary.begin() + 200);
+    const auto queries = GenerateQueries(generator, topic, 2000, 7);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    size_t found_count = 0;
+    {
+        LOG_DURATION("ProcessQueries"s);
+        for (const auto& documents : ProcessQueries(search_server, queries)) {
+            found_count += documents.size();
+        }
+    }
+    cout << found_count << endl;
+    found_count = 0;
+    {
+        LOG_DURATION("ProcessQueriesBatched"s);
+        for (const auto& documents : ProcessQueriesBatched(search_server, queries)) {
+            found_count += documents.size();
+        }
+    }
+    cout << found_count << endl;
+}
+
+void TestPerformanceSparseBatchQueries(){
+    mt19937 generator;
+    // большой словарь: у каждого слова немного документов, и запросы пакета почти не делят слов
+    const auto dictionary = GenerateDictionary(generator, 50'000, 12);
+    const auto texts = GenerateQueries(generator, dictionary, 100'000, 10);
+    const auto queries = GenerateQueries(generator, dictionary, 4000, 3);
+    SearchServer search_server(""s);
+    vector<NewDocument> batch;
+    batch.reserve(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+    }
+    search_server.AddDocuments(batch);
+    // лучшее время из нескольких прогонов меньше зависит от соседних процессов
+    const auto measure = [](string_view mark, const auto& run) {
+        auto best = LogDuration::Clock::duration::max();
+        size_t found_count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const auto start = LogDuration::Clock::now();
+            found_count = 0;
+            for (const auto& documents : run()) {
+                found_count += documents.size();
+            }
+            best = min(best, LogDuration::Clock::now() - start);
+        }
+        cout << mark << ": "s << chrono::duration_cast<chrono::milliseconds>(best).count() << " ms, found "s << found_count << endl;
+        return best;
+    };
+    const auto per_query = measure("sparse ProcessQueries"s, [&]() { return ProcessQueries(search_server, queries); });
+    const auto batched = measure("sparse ProcessQueriesBatched"s, [&]() { return ProcessQueriesBatched(search_server, queries); });
+    // пакет без общих слов выполняется по запросам и не медленнее их
+    ASSERT(batched <= per_query * 5 / 4 + chrono::milliseconds(5));
+}
+
+//Тест плоской выдачи пакета и потоковой обработки запросов
+void TestJoinedResults(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 2000, 15);
+    auto queries = GenerateQueries(generator, dictionary, 500, 3);
+    queries[7] = "-"s + dictionary[1];
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 5)});
+    }
+    const auto expected = ProcessQueries(search_server, queries);
+
+    const JoinedResults joined = ProcessQueriesJoined(search_server, queries);
+    ASSERT_EQUAL(joined.GetQueryCount(), queries.size());
+    ASSERT(joined.GetQueryResults(7).begin() == joined.GetQueryResults(7).end());
+    size_t position = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const auto query_results = joined.GetQueryResults(i);
+        ASSERT_EQUAL(query_results.size(), expected[i].size());
+        ASSERT(query_results.begin() == joined.begin() + position);
+        for (const Document& document : expected[i]) {
+            ASSERT_EQUAL(joined[position].id, document.id);
+            ASSERT_EQUAL(joined[position].relevance, document.relevance);
+            ++position;
+        }
+    }
+    ASSERT_EQUAL(joined.size(), position);
+    ASSERT_EQUAL(static_cast<size_t>(joined.end() - joined.begin()), position);
+    try {
+        joined.GetQueryResults(queries.size());
+        ASSERT_HINT(false, "Ожидалось исключение для неверного номера запроса"s);
+    } catch (const out_of_range&) {
+    }
+    ASSERT(JoinedResults().empty());
+    ASSERT_EQUAL(JoinedResults().GetQueryCount(), 0u);
+
+    // выдачи приходят по одной на запрос, в порядке запросов
+    size_t next_query = 0;
+    ProcessQueriesStreamed(search_server, queries, [&next_query, &expected](size_t query_index, const vector<Document>& documents) {
+        ASSERT_EQUAL(query_index, next_query);
+        ASSERT_EQUAL(documents.size(), expected[query_index].size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQUAL(documents[i].id, expected[query_index][i].id);
+        }
+        ++next_query;
+    });
+    ASSERT_EQUAL(next_query, queries.size());
+    ProcessQueriesStreamed(search_server, {}, [](size_t, const vector<Document>&) {
+        ASSERT_HINT(false, "Пустой пакет не должен давать выдач"s);
+    });
+    // ошибка разбора запроса доходит до вызывающего
+    try {
+        ProcessQueriesStreamed(search_server, {queries[0], "cat --dog"s}, [](size_t, const vector<Document>&) {});
+        ASSERT_HINT(false, "Ожидалось исключение для неверного запроса"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestPerformanceJoinedResults(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2000, 25);
+    const auto texts = GenerateQueries(generator, dictionary, 20000, 10);
+    const auto queries = GenerateQueries(generator, dictionary, 100000, 3);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    // сравнивается только склейка готовых выдач
+    const auto results = ProcessQueries(search_server, queries);
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        auto copy = results;
+        LOG_DURATION("list of documents"s);
+        list<Document> documents;
+        for (auto& query_documents : copy) {
+            for (auto& document : query_documents) {
+                documents.push_back(move(document));
+            }
+        }
+        ASSERT(!documents.empty());
+    }
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        auto copy = results;
+        LOG_DURATION("JoinedResults"s);
+        const JoinedResults documents(move(copy));
+        ASSERT(!documents.empty());
+    }
+    // вместе с поиском: выдачи пишутся сразу в общий буфер, без промежуточного вектора векторов
+    const vector<string> search_queries(queries.begin(), queries.begin() + 20000);
+    {
+        LOG_DURATION("ProcessQueries and JoinedResults"s);
+        const JoinedResults documents(ProcessQueries(search_server, search_queries));
+        ASSERT_EQUAL(documents.GetQueryCount(), search_queries.size());
+    }
+    {
+        LOG_DURATION("ProcessQueriesJoined"s);
+        const JoinedResults documents = ProcessQueriesJoined(search_server, search_queries);
+        ASSERT_EQUAL(documents.GetQueryCount(), search_queries.size());
+    }
+}
+
+//Тест поиска со сроком и отменой
+void TestSearchBudget(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 20000, 30);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 6);
+    SearchServer search_server(dictionary[0]);
+    search_server.SetRefreshInterval(5000);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+
+    // без срока выдача полная и совпадает с обычным поиском при любом способе обхода
+    for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        SearchOptions options;
+        options.top_k = 10;
+        options.mode = mode;
+        for (const string& query : queries) {
+            const SearchBudget budget;
+            const BudgetedResult result = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options, budget);
+            const auto expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+            ASSERT(result.is_complete);
+            ASSERT(!budget.IsInterrupted());
+            ASSERT_EQUAL(result.documents.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(result.documents[i].id, expected[i].id);
+                ASSERT_EQUAL(result.documents[i].relevance, expected[i].relevance);
+            }
+        }
+        auto future = search_server.FindTopDocumentsAsync(queries[0], DocumentStatus::ACTUAL, options, make_shared<SearchBudget>(chrono::hours(1)));
+        const BudgetedResult result = future.get();
+        ASSERT(result.is_complete);
+        ASSERT_EQUAL(result.documents.size(), search_server.FindTopDocuments(queries[0], DocumentStatus::ACTUAL, options).size());
+    }
+
+    // асинхронные поиски занимают потоки общего пула, а сервер при разрушении дожидается начатых поисков
+    ASSERT_EQUAL(SearchExecutor::Shared().GetThreadCount(), static_cast<size_t>(max(1u, thread::hardware_concurrency())));
+    {
+        auto async_server = make_unique<SearchServer>(search_server);
+        vector<future<BudgetedResult>> futures;
+        for (size_t i = 0; i < 200; ++i) {
+            futures.push_back(async_server->FindTopDocumentsAsync(queries[i % queries.size()], DocumentStatus::ACTUAL, {}, make_shared<SearchBudget>()));
+        }
+        async_server.reset();
+        for (size_t i = 0; i < futures.size(); ++i) {
+            ASSERT_EQUAL(futures[i].get().documents.size(), search_server.FindTopDocuments(queries[i % queries.size()]).size());
+        }
+    }
+
+    // истекший срок: неполная выдача или ошибка, смотря по ExpiryAction
+    const auto expired = SearchBudget::Clock::now() - chrono::seconds(1);
+    search_server.EnableResultCache(1 << 20, 4);
+    const BudgetedResult partial = search_server.FindTopDocuments(queries[0], DocumentStatus::ACTUAL, {}, SearchBudget(expired));
+    ASSERT(!partial.is_complete);
+    ASSERT(partial.documents.empty());
+    try {
+        search_server.FindTopDocumentsAsync(queries[0], DocumentStatus::ACTUAL, {}, make_shared<SearchBudget>(expired, ExpiryAction::CANCEL)).get();
+        ASSERT_HINT(false, "Ожидалось исключение по истечении срока"s);
+    } catch (const system_error& error) {
+        ASSERT(error.code() == errc::timed_out);
+    }
+    // неполная выдача не попадает в кэш
+    ASSERT(!search_server.FindTopDocuments(queries[0]).empty());
+    ASSERT_EQUAL(search_server.GetResultCacheStats().hits, 0u);
+    search_server.DisableResultCache();
+
+    // отмена из другого потока прерывает поиск при любом ExpiryAction
+    const auto cancelled = make_shared<SearchBudget>();
+    cancelled->Cancel();
+    try {
+        search_server.FindTopDocumentsAsync(queries[0], DocumentStatus::ACTUAL, {}, cancelled).get();
+        ASSERT_HINT(false, "Ожидалось исключение после отмены"s);
+    } catch (const system_error& error) {
+        ASSERT(error.code() == errc::operation_canceled);
+    }
+
+    // срок, истекающий во время обхода: выдача в пределах окна, а релевантность
+    // неполной выдачи не больше полной
+    for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        SearchOptions options;
+        options.top_k = 1000;
+        options.mode = mode;
+        SearchOptions all_options = options;
+        all_options.top_k = texts.size();
+        map<int, double> full_relevance;
+        for (const Document& document : search_server.FindTopDocuments(queries[1], DocumentStatus::ACTUAL, all_options)) {
+            full_relevance[document.id] = document.relevance;
+        }
+        for (const auto timeout : {chrono::microseconds(10), chrono::microseconds(100), chrono::microseconds(1000)}) {
+            const BudgetedResult result = search_server.FindTopDocuments(queries[1], DocumentStatus::ACTUAL, options, SearchBudget(timeout));
+            ASSERT(result.documents.size() <= options.top_k);
+            for (const Document& document : result.documents) {
+                ASSERT(full_relevance.count(document.id) > 0);
+                ASSERT(document.relevance <= full_relevance.at(document.id) + EPSILON);
+            }
+        }
+    }
+
+    // отбор по фильтру тоже сверяется с бюджетом и останавливается, не дойдя до конца таблицы
+    DocumentTable table;
+    for (int id = 0; id < 300000; ++id) {
+        table.Add(id, id % 7, DocumentStatus::ACTUAL);
+    }
+    const auto count_slots = [](const SlotBitmap& slots) {
+        size_t count = 0;
+        slots.ForEach([&count](uint32_t) { ++count; });
+        return count;
+    };
+    DocumentFilter rating_filter;
+    rating_filter.min_rating = 3;
+    for (const DocumentFilter& filter : {DocumentFilter{}, rating_filter}) {
+        SearchBudget stopped;
+        stopped.Cancel();
+        ASSERT(2 * count_slots(table.Select(filter, &stopped)) < count_slots(table.Select(filter)));
+        ASSERT(stopped.IsInterrupted());
+    }
+}
+
+void TestPerformanceSearchBudget(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 100, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 200000, 30);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    // запрос из частых слов обходит почти все вхождения индекса
+    string heavy_query;
+    for (size_t i = 1; i < 30; ++i) {
+        heavy_query += dictionary[i] + " "s;
+    }
+    {
+        LOG_DURATION("without deadline"s);
+        cout << search_server.FindTopDocuments(heavy_query, DocumentStatus::ACTUAL, {}, SearchBudget()).is_complete << endl;
+    }
+    {
+        LOG_DURATION("deadline 5 ms"s);
+        cout << search_server.FindTopDocuments(heavy_query, DocumentStatus::ACTUAL, {}, SearchBudget(chrono::milliseconds(5))).is_complete << endl;
+    }
+    // минус-слова строят битовую карту по своим вхождениям, и это построение тоже укладывается в срок
+    string minus_query = heavy_query;
+    for (size_t i = 30; i < 60; ++i) {
+        minus_query += "-"s + dictionary[i] + " "s;
+    }
+    {
+        LOG_DURATION("minus words, without deadline"s);
+        cout << search_server.FindTopDocuments(minus_query, DocumentStatus::ACTUAL, {}, SearchBudget()).is_complete << endl;
+    }
+    {
+        LOG_DURATION("minus words, deadline 1 ms"s);
+        cout << search_server.FindTopDocuments(minus_query, DocumentStatus::ACTUAL, {}, SearchBudget(chrono::milliseconds(1))).is_complete << endl;
+    }
+}
+
+//Тест накопителей релевантности для редких слов
+void TestRareWordAccumulation(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 5);
+    const auto documents = GenerateQueries(generator, dictionary, 20000, 5);
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        string text = documents[i];
+        if (i % 500 == 3) {
+            text += " rareword"s;
+        }
+        if (i % 700 == 5) {
+            text += " otherrare rareword"s;
+        }
+        search_server.AddDocument(i, text, DocumentStatus::ACTUAL, {static_cast<int>(i % 5)});
+    }
+    search_server.RemoveDocument(3);
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT(fabs(lhs[i].relevance - rhs[i].relevance) < EPSILON);
+        }
+    };
+    SearchOptions max_score_options{20, 0, EvaluationMode::MAX_SCORE};
+    const vector<string> queries = {
+        "rareword"s,
+        "rareword otherrare"s,
+        "rareword -otherrare"s,
+        "rareword "s + dictionary[1],
+        dictionary[1] + " "s + dictionary[2] + " -rareword"s,
+    };
+    for (const string& query : queries) {
+        const auto expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score_options);
+        // повторный запрос видит накопитель, очищенный предыдущим
+        for (int i = 0; i < 2; ++i) {
+            check_equal(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, SearchOptions{20, 0}), expected);
+            check_equal(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, SearchOptions{20, 0}), expected);
+        }
+    }
+
+    DocumentFilter filter;
+    filter.min_rating = 2;
+    filter.id_ranges.push_back({0, 10000});
+    const auto filtered = search_server.FindTopDocuments(execution::seq, "rareword -otherrare"s, filter, SearchOptions{20, 0});
+    ASSERT(!filtered.empty());
+    for (const Document& document : filtered) {
+        ASSERT(document.rating >= 2 && document.id <= 10000);
+    }
+    check_equal(filtered, search_server.FindTopDocuments("rareword -otherrare"s, [](int document_id, DocumentStatus, int rating) {
+        return rating >= 2 && document_id <= 10000;
+    }, SearchOptions{20, 0}));
+
+    // поиск внутри предиката берет свой накопитель и не портит накопитель потока
+    const auto expected = search_server.FindTopDocuments("rareword"s);
+    const auto nested = search_server.FindTopDocuments("rareword"s, [&search_server](int, DocumentStatus, int) {
+        return !search_server.FindTopDocuments("otherrare"s).empty();
+    });
+    check_equal(nested, expected);
+
+    // удаленные, исключенные минус-словом и отфильтрованные документы не попадают в накопитель
+    // ни при разреженном (rare), ни при плотном (common) накоплении
+    SearchServer counted_server(""s);
+    for (int id = 0; id < 20000; ++id) {
+        string text = "common"s;
+        if (id % 100 == 0) {
+            text += " rare"s;
+        }
+        if (id % 200 == 0) {
+            text += " minus"s;
+        }
+        counted_server.AddDocument(id, text, id % 300 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {1});
+    }
+    for (int id = 50; id < 20000; id += 1000) {
+        counted_server.RemoveDocument(id);
+    }
+    for (const string& word : {"rare"s, "common"s}) {
+        size_t expected_count = 0;
+        for (int id = 0; id < 20000; ++id) {
+            expected_count += (word == "common"s || id % 100 == 0) && id % 200 != 0 && id % 300 != 0 && id % 1000 != 50;
+        }
+        SearchStats stats;
+        SearchOptions options{100'000, 0};
+        options.stats = &stats;
+        ASSERT_EQUAL(counted_server.FindTopDocuments(word + " -minus"s, DocumentStatus::ACTUAL, options).size(), expected_count);
+        ASSERT_EQUAL_HINT(stats.scored_postings, expected_count, word);
+        stats = {};
+        ASSERT_EQUAL(counted_server.FindTopDocuments(execution::par, word + " -minus"s, DocumentStatus::ACTUAL, options).size(), expected_count);
+        ASSERT_EQUAL_HINT(stats.scored_postings, expected_count, word);
+    }
+}
+
+void TestPerformanceRareWordQueries(){
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 200'000, 5);
+    // каждое из редких слов встречается в одном документе из ста
+    vector<string> rare_words;
+    for (int i = 0; i < 100; ++i) {
+        rare_words.push_back("rare"s + to_string(i));
+    }
+    vector<string> documents(texts.size());
+    vector<NewDocument> batch;
+    batch.reserve(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        documents[i] = texts[i] + " "s + rare_words[i % rare_words.size()];
+        batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)}});
+    }
+    SearchServer search_server(""s);
+    search_server.AddDocuments(batch);
+
+    DocumentFilter filter;
+    filter.min_rating = 5;
+    size_t total = 0;
+    {
+        LOG_DURATION("rare word queries"s);
+        for (int i = 0; i < 2000; ++i) {
+            const string& word = rare_words[i % rare_words.size()];
+            total += search_server.FindTopDocuments(word).size();
+            total += search_server.FindTopDocuments(execution::seq, word + " -"s + dictionary[i % dictionary.size()], filter).size();
+        }
+    }
+    cout << total << endl;
+}
@@ -8,6 +8,9 @@
 #include <string>
 #include <vector>
 #include "search_server.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "query_arena.h"
 #include "log_duration.h"
 using namespace std;
 template <typename T, typename U>
@@ -60,6 +63,11 @@ std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string
 
 std::vector<std::string> GenerateQueries(std::mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count);
 
+// тексты по темам: text_count текстов, i-й о теме i % topic_count. В тексте background_word_count
+// общих слов с частотами 1/ранг и topic_word_count слов словаря своей темы
+std::vector<std::string> GenerateTopicalTexts(std::mt19937& generator, const std::vector<std::string>& dictionary, int text_count, int topic_count,
+                                              int background_word_count, int topic_word_count);
+
 template <typename ExecutionPolicy>
 void TestMatchDocPerf(std::string_view mark, SearchServer search_server, const std::string& query, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -129,3 +137,65 @@ void TestPerformanceParallelMatching();
 
 void TestParallelFindTopDocuments();
 void TestPerformanceParallelFindTop();
+//Тест словаря терминов
+void TestTermDictionary();
+//Тест списка вхождений термина
+void TestPostingList();
+//Тест позиционного доступа к документам и обхода их id
+void TestDocumentPositionalAccess();
+void TestPerformanceDocumentIdOrder();
+//Тест выдачи с заданным числом документов и смещением
+void TestTopDocumentsWindow();
+//Тест совпадения выдачи MaxScore с полным перебором
+void TestMaxScoreMatchesExhaustive();
+void TestMaxScoreScoredPostings();
+void TestPerformanceMaxScore();
+//Тест IDF после удаления документов
+void TestInverseDocumentFreqAfterRemove();
+//Тест декларативного фильтра документов
+void TestDocumentFilter();
+//Тест кэша выдачи запросов
+void TestQueryResultCache();
+//Тест арены разбора запросов
+void TestQueryArena();
+//Тест векторного токенизатора
+void TestTokenizer();
+void TestPerformanceTokenizer();
+//Тест освобождения и уплотнения строк терминов
+void TestTermStorageReclaim();
+//Тест удаления пометкой и уплотнения списков вхождений
+void TestTombstoneDelete();
+//Тест пакетного добавления документов
+void TestAddDocuments();
+void TestPerformanceAddDocuments();
+//Тест индекса из сегментов
+void TestSegmentedIndex();
+void TestPerformanceRefresh();
+//Тест сжатых сегментов
+void TestCompressedSegments();
+void TestPerformanceCompressedSegments();
+//Тест чтения снимков индекса во время записи
+void TestSnapshotSearchServer();
+void TestPerformancePublish();
+//Тест сохранения и загрузки индекса
+void TestSaveLoad();
+void TestPerformanceLoad();
+//Тест журнала упреждающей записи и восстановления после сбоя
+void TestDurableSearchServer();
+void TestPerformanceWriteAheadLog();
+//Тест загрузки корпуса из файла
+void TestLoadCorpus();
+void TestPerformanceLoadCorpus();
+//Тест пакетного выполнения запросов
+void TestFindTopDocumentsBatch();
+void TestPerformanceBatchQueries();
+void TestPerformanceSparseBatchQueries();
+//Тест плоской выдачи пакета и потоковой обработки запросов
+void TestJoinedResults();
+void TestPerformanceJoinedResults();
+//Тест поиска со сроком и отменой
+void TestSearchBudget();
+void TestPerformanceSearchBudget();
+//Тест накопителей релевантности для редких слов
+void TestRareWordAccumulation();
+void TestPerformanceRareWordQueries();
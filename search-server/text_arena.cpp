@@ -0,0 +1,132 @@
+#include "text_arena.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+TextArena::TextArena(const TextArena& other)
+    : chunks_(other.chunks_), free_chunks_(other.free_chunks_), chunk_by_address_(other.chunk_by_address_),
+      allocated_bytes_(other.allocated_bytes_), live_bytes_(other.live_bytes_) {
+    // в остаток текущего куска продолжает писать исходная арена, копия начнет новый кусок
+}
+
+TextArena& TextArena::operator=(const TextArena& other) {
+    if (this != &other) {
+        *this = TextArena(other);
+    }
+    return *this;
+}
+
+TextArena::TextArena(TextArena&& other) noexcept {
+    *this = std::move(other);
+}
+
+TextArena& TextArena::operator=(TextArena&& other) noexcept {
+    if (this != &other) {
+        chunks_ = std::move(other.chunks_);
+        free_chunks_ = std::move(other.free_chunks_);
+        chunk_by_address_ = std::move(other.chunk_by_address_);
+        current_ = std::exchange(other.current_, 0);
+        has_current_ = std::exchange(other.has_current_, false);
+        allocated_bytes_ = std::exchange(other.allocated_bytes_, 0);
+        live_bytes_ = std::exchange(other.live_bytes_, 0);
+        other.chunks_.clear();
+        other.free_chunks_.clear();
+        other.chunk_by_address_.clear();
+    }
+    return *this;
+}
+
+std::string_view TextArena::Store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    size_t index = current_;
+    if (text.size() > CHUNK_SIZE) {
+        index = AllocateChunk(text.size());
+    } else if (!has_current_ || chunks_[current_].size - chunks_[current_].used < text.size()) {
+        // недописанный остаток прежнего куска освободится вместе с ним
+        if (has_current_ && chunks_[current_].live == 0) {
+            FreeChunk(current_);
+        }
+        current_ = AllocateChunk(CHUNK_SIZE);
+        has_current_ = true;
+        index = current_;
+    }
+    Chunk& chunk = chunks_[index];
+    char* const destination = chunk.data.get() + chunk.used;
+    std::memcpy(destination, text.data(), text.size());
+    chunk.used += text.size();
+    chunk.live += text.size();
+    live_bytes_ += text.size();
+    return {destination, text.size()};
+}
+
+void TextArena::Release(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    const size_t index = FindChunk(text);
+    chunks_[index].live -= text.size();
+    live_bytes_ -= text.size();
+    if (chunks_[index].live == 0 && !(has_current_ && index == current_)) {
+        FreeChunk(index);
+    }
+}
+
+bool TextArena::IsInSparseChunk(std::string_view text) const {
+    if (text.empty()) {
+        return false;
+    }
+    const size_t index = FindChunk(text);
+    return !(has_current_ && index == current_) && 2 * chunks_[index].live < chunks_[index].used;
+}
+
+bool TextArena::NeedsCompaction() const {
+    const size_t dead_bytes = allocated_bytes_ - live_bytes_;
+    return dead_bytes > CHUNK_SIZE && dead_bytes > live_bytes_;
+}
+
+std::shared_ptr<const void> TextArena::PinChunks() const {
+    auto buffers = std::make_shared<std::vector<std::shared_ptr<char[]>>>();
+    buffers->reserve(chunks_.size());
+    for (const Chunk& chunk : chunks_) {
+        if (chunk.data != nullptr) {
+            buffers->push_back(chunk.data);
+        }
+    }
+    return buffers;
+}
+
+size_t TextArena::FindChunk(std::string_view text) const {
+    return std::prev(chunk_by_address_.upper_bound(text.data()))->second;
+}
+
+size_t TextArena::AllocateChunk(size_t size) {
+    size_t index = chunks_.size();
+    if (free_chunks_.empty()) {
+        chunks_.emplace_back();
+    } else {
+        index = free_chunks_.back();
+        free_chunks_.pop_back();
+    }
+    Chunk& chunk = chunks_[index];
+    chunk.data = std::shared_ptr<char[]>(new char[size]);
+    chunk.size = size;
+    chunk.used = 0;
+    chunk.live = 0;
+    chunk_by_address_.emplace(chunk.data.get(), index);
+    allocated_bytes_ += size;
+    return index;
+}
+
+void TextArena::FreeChunk(size_t index) {
+    Chunk& chunk = chunks_[index];
+    chunk_by_address_.erase(chunk.data.get());
+    allocated_bytes_ -= chunk.size;
+    chunk = Chunk{};
+    free_chunks_.push_back(index);
+    if (has_current_ && index == current_) {
+        has_current_ = false;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Хранилище коротких строк кусками фиксированного размера. Для каждого куска считается
+// объем живых строк: кусок без живых строк освобождается сразу, а строки из полупустых
+// кусков владелец переносит при уплотнении (IsInSparseChunk + Store + Release).
+// Копии делят память кусков: записанные байты не меняются, а недописанный остаток куска
+// достается только той арене, что писала в него первой.
+class TextArena {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    TextArena() = default;
+    // копирует учет кусков, а не строки: string_view исходной арены действительны и для копии
+    TextArena(const TextArena& other);
+    TextArena& operator=(const TextArena& other);
+    // куски переходят целиком, строки остаются на месте, и выданные ими string_view действительны;
+    // исходная арена становится пустой
+    TextArena(TextArena&& other) noexcept;
+    TextArena& operator=(TextArena&& other) noexcept;
+
+    // копирует text в текущий кусок; строка длиннее куска получает собственный кусок
+    std::string_view Store(std::string_view text);
+    // text должен быть получен от Store этой арены
+    void Release(std::string_view text);
+    // живые строки занимают меньше половины куска, и в кусок больше не пишут
+    bool IsInSparseChunk(std::string_view text) const;
+    // мертвые байты в полупустых кусках окупают перенос живых строк
+    bool NeedsCompaction() const;
+    // держит память всех нынешних кусков: их строки остаются доступны, пока жив результат,
+    // даже если арена освободит куски
+    std::shared_ptr<const void> PinChunks() const;
+
+    size_t GetAllocatedBytes() const {
+        return allocated_bytes_;
+    }
+    size_t GetLiveBytes() const {
+        return live_bytes_;
+    }
+
+private:
+    struct Chunk {
+        std::shared_ptr<char[]> data;
+        size_t size = 0;
+        size_t used = 0;
+        size_t live = 0;
+    };
+
+    std::vector<Chunk> chunks_;
+    // номера освобожденных кусков для повторного использования
+    std::vector<size_t> free_chunks_;
+    // адрес начала куска -> его номер
+    std::map<const char*, size_t> chunk_by_address_;
+    size_t current_ = 0;
+    bool has_current_ = false;
+    size_t allocated_bytes_ = 0;
+    size_t live_bytes_ = 0;
+
+    size_t FindChunk(std::string_view text) const;
+    size_t AllocateChunk(size_t size);
+    void FreeChunk(size_t index);
+};
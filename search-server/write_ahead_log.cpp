@@ -0,0 +1,213 @@
+#include "write_ahead_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "index_file.h"
+
+namespace {
+
+// заголовок записи: контрольная сумма, длина полезной части, тип и номер;
+// полезная часть дополняется нулями до кратной 8 длины
+const size_t RECORD_HEADER_SIZE = 24;
+
+size_t PadTo8(size_t size) {
+    return (size + 7) / 8 * 8;
+}
+
+template <typename T>
+void AppendValue(std::vector<char>& buffer, T value) {
+    const char* const bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T ReadValue(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t next_sequence, uint64_t valid_size, const WriteAheadLogOptions& options)
+    : path_(path), next_sequence_(next_sequence), options_(options) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Не удалось открыть журнал " + path);
+    }
+    if (ftruncate(fd_, static_cast<off_t>(valid_size)) != 0 || lseek(fd_, 0, SEEK_END) < 0) {
+        close(fd_);
+        throw std::runtime_error("Не удалось открыть журнал " + path);
+    }
+    if (options_.sync_max_delay.count() > 0) {
+        flusher_ = std::thread([this]() { RunFlusher(); });
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (flusher_.joinable()) {
+        {
+            std::lock_guard lock(mutex_);
+            is_stopping_ = true;
+        }
+        batch_started_.notify_one();
+        flusher_.join();
+    }
+    try {
+        Sync();
+    } catch (...) {
+    }
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAdd(int document_id, std::string_view text, DocumentStatus status, const std::vector<int>& ratings) {
+    std::vector<char> payload;
+    payload.reserve(16 + ratings.size() * sizeof(int) + text.size());
+    AppendValue<int32_t>(payload, document_id);
+    AppendValue<int32_t>(payload, static_cast<int32_t>(status));
+    AppendValue<uint32_t>(payload, static_cast<uint32_t>(ratings.size()));
+    AppendValue<uint32_t>(payload, static_cast<uint32_t>(text.size()));
+    for (const int rating : ratings) {
+        AppendValue<int32_t>(payload, rating);
+    }
+    payload.insert(payload.end(), text.begin(), text.end());
+    Append(LogRecordType::ADD_DOCUMENT, next_sequence_, payload);
+    return next_sequence_++;
+}
+
+uint64_t WriteAheadLog::AppendRemove(int document_id) {
+    std::vector<char> payload;
+    AppendValue<int32_t>(payload, document_id);
+    Append(LogRecordType::REMOVE_DOCUMENT, next_sequence_, payload);
+    return next_sequence_++;
+}
+
+void WriteAheadLog::Append(LogRecordType type, uint64_t sequence, const std::vector<char>& payload) {
+    std::unique_lock lock(mutex_);
+    const size_t record_begin = buffer_.size();
+    buffer_.resize(record_begin + RECORD_HEADER_SIZE + PadTo8(payload.size()), 0);
+    char* const record = buffer_.data() + record_begin;
+    const uint32_t payload_size = static_cast<uint32_t>(payload.size());
+    std::memcpy(record + 8, &payload_size, sizeof(payload_size));
+    std::memcpy(record + 12, &type, sizeof(type));
+    std::memcpy(record + 16, &sequence, sizeof(sequence));
+    std::memcpy(record + RECORD_HEADER_SIZE, payload.data(), payload.size());
+    const uint64_t checksum = ComputeIndexChecksum(record + 8, buffer_.size() - record_begin - 8, INDEX_CHECKSUM_SEED);
+    std::memcpy(record, &checksum, sizeof(checksum));
+
+    ++buffered_records_;
+    if ((options_.sync_batch_records > 0 && buffered_records_ >= options_.sync_batch_records)
+        || buffer_.size() >= options_.sync_batch_bytes) {
+        SyncLocked();
+    } else if (record_begin == 0) {
+        // первая запись пакета: с нее отсчитывается срок фонового сброса
+        batch_start_time_ = std::chrono::steady_clock::now();
+        lock.unlock();
+        batch_started_.notify_one();
+    }
+}
+
+void WriteAheadLog::Sync() {
+    std::lock_guard lock(mutex_);
+    SyncLocked();
+}
+
+void WriteAheadLog::RunFlusher() {
+    std::unique_lock lock(mutex_);
+    while (!is_stopping_) {
+        if (buffer_.empty()) {
+            batch_started_.wait(lock, [this]() { return is_stopping_ || !buffer_.empty(); });
+            continue;
+        }
+        const auto deadline = batch_start_time_ + options_.sync_max_delay;
+        if (std::chrono::steady_clock::now() < deadline) {
+            batch_started_.wait_until(lock, deadline);
+            continue;
+        }
+        try {
+            SyncLocked();
+        } catch (const std::runtime_error&) {
+            // несброшенное остается в буфере, а ошибку увидит следующий Sync писателя
+            batch_start_time_ = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+void WriteAheadLog::SyncLocked() {
+    if (buffer_.empty() && !has_unsynced_data_) {
+        return;
+    }
+    // один fdatasync на весь пакет записей; write может записать пакет по частям
+    size_t written = 0;
+    while (written < buffer_.size()) {
+        const ssize_t result = write(fd_, buffer_.data() + written, buffer_.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            // записанное уже в файле: повторный Sync не должен дописать его второй раз
+            buffer_.erase(buffer_.begin(), buffer_.begin() + written);
+            throw std::runtime_error("Не удалось записать журнал " + path_);
+        }
+        written += static_cast<size_t>(result);
+        has_unsynced_data_ = true;
+    }
+    buffer_.clear();
+    buffered_records_ = 0;
+    int result;
+    do {
+        result = fdatasync(fd_);
+    } while (result != 0 && errno == EINTR);
+    if (result != 0) {
+        throw std::runtime_error("Не удалось записать журнал " + path_);
+    }
+    has_unsynced_data_ = false;
+}
+
+bool WriteAheadLog::ReadRecord(const MappedFile& file, uint64_t& offset, LogRecord& record) {
+    const uint64_t remaining = file.GetSize() - offset;
+    if (remaining < RECORD_HEADER_SIZE) {
+        return false;
+    }
+    const char* const data = file.GetData() + offset;
+    const uint32_t payload_size = ReadValue<uint32_t>(data + 8);
+    const size_t record_size = RECORD_HEADER_SIZE + PadTo8(payload_size);
+    if (record_size > remaining
+        || ComputeIndexChecksum(data + 8, record_size - 8, INDEX_CHECKSUM_SEED) != ReadValue<uint64_t>(data)) {
+        return false;
+    }
+    const char* const payload = data + RECORD_HEADER_SIZE;
+    record.type = ReadValue<LogRecordType>(data + 12);
+    record.sequence = ReadValue<uint64_t>(data + 16);
+    record.ratings.clear();
+    record.text = {};
+    if (record.type == LogRecordType::ADD_DOCUMENT) {
+        if (payload_size < 16) {
+            return false;
+        }
+        record.document_id = ReadValue<int32_t>(payload);
+        record.status = static_cast<DocumentStatus>(ReadValue<int32_t>(payload + 4));
+        const uint32_t rating_count = ReadValue<uint32_t>(payload + 8);
+        const uint32_t text_size = ReadValue<uint32_t>(payload + 12);
+        if (payload_size != 16 + uint64_t{rating_count} * sizeof(int32_t) + text_size) {
+            return false;
+        }
+        for (uint32_t i = 0; i < rating_count; ++i) {
+            record.ratings.push_back(ReadValue<int32_t>(payload + 16 + i * sizeof(int32_t)));
+        }
+        record.text = {payload + 16 + rating_count * sizeof(int32_t), text_size};
+    } else if (record.type == LogRecordType::REMOVE_DOCUMENT) {
+        if (payload_size != sizeof(int32_t)) {
+            return false;
+        }
+        record.document_id = ReadValue<int32_t>(payload);
+    } else {
+        return false;
+    }
+    offset += record_size;
+    return true;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+#include "mapped_file.h"
+
+// как часто журнал сбрасывается на диск
+struct WriteAheadLogOptions {
+    // записи копятся в памяти и уходят на диск одним write и одним fdatasync на пакет;
+    // 1 - после каждой операции, 0 - только по Sync
+    size_t sync_batch_records = 256;
+    // пакет сбрасывается и тогда, когда в нем набирается столько байт
+    size_t sync_batch_bytes = 1 << 20;
+    // и не позже, чем через столько после первой записи пакета, даже если новых записей нет:
+    // это делает фоновый поток журнала. 0 - без ограничения по времени
+    std::chrono::milliseconds sync_max_delay = std::chrono::milliseconds(10);
+};
+
+enum class LogRecordType : uint32_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+};
+
+// операция из журнала; text указывает в отображенный файл журнала
+struct LogRecord {
+    uint64_t sequence = 0;
+    LogRecordType type = LogRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+// Журнал упреждающей записи: файл из записей с номерами подряд. Каждая запись хранит
+// контрольную сумму, поэтому недописанный при сбое хвост распознается и отбрасывается.
+class WriteAheadLog {
+public:
+    // продолжает файл path, первая новая запись получит номер next_sequence;
+    // хвост после valid_size байт (недописанная запись) обрезается
+    WriteAheadLog(const std::string& path, uint64_t next_sequence, uint64_t valid_size, const WriteAheadLogOptions& options);
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    // останавливает фоновый сброс и сбрасывает накопленные записи
+    ~WriteAheadLog();
+
+    // возвращают номер записи; запись надежна после сброса ее пакета.
+    // Добавлять записи и вызывать Sync можно только из одного потока
+    uint64_t AppendAdd(int document_id, std::string_view text, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendRemove(int document_id);
+    // записывает накопленный пакет и ждет fdatasync. После ошибки в буфере остаются только
+    // незаписанные байты, и повторный Sync продолжает с них
+    void Sync();
+
+    uint64_t GetLastSequence() const {
+        return next_sequence_ - 1;
+    }
+
+    // результат чтения журнала: последняя целая запись и длина файла до конца этой записи
+    struct ReplayResult {
+        uint64_t last_sequence = 0;
+        uint64_t valid_size = 0;
+        bool is_torn = false;
+    };
+    // вызывает handler для записей с номерами больше after_sequence по порядку.
+    // Чтение останавливается на первой поврежденной или недописанной записи
+    template <typename Handler>
+    static ReplayResult Replay(const std::string& path, uint64_t first_sequence, uint64_t after_sequence, Handler handler);
+
+private:
+    int fd_ = -1;
+    std::string path_;
+    uint64_t next_sequence_;
+    WriteAheadLogOptions options_;
+    std::vector<char> buffer_;
+    size_t buffered_records_ = 0;
+    // в файл записаны байты, еще не подтвержденные fdatasync
+    bool has_unsynced_data_ = false;
+    // буфер и файл делятся с фоновым потоком, который сбрасывает залежавшийся пакет
+    std::mutex mutex_;
+    std::condition_variable batch_started_;
+    std::chrono::steady_clock::time_point batch_start_time_;
+    bool is_stopping_ = false;
+    std::thread flusher_;
+
+    void Append(LogRecordType type, uint64_t sequence, const std::vector<char>& payload);
+    void SyncLocked();
+    void RunFlusher();
+    // разбирает запись с позиции offset; false, если записи там нет целиком или она повреждена
+    static bool ReadRecord(const MappedFile& file, uint64_t& offset, LogRecord& record);
+};
+
+template <typename Handler>
+WriteAheadLog::ReplayResult WriteAheadLog::Replay(const std::string& path, uint64_t first_sequence, uint64_t after_sequence, Handler handler) {
+    const MappedFile file(path);
+    ReplayResult result;
+    result.last_sequence = first_sequence - 1;
+    uint64_t offset = 0;
+    LogRecord record;
+    while (offset < file.GetSize()) {
+        uint64_t next_offset = offset;
+        if (!ReadRecord(file, next_offset, record) || record.sequence != result.last_sequence + 1) {
+            result.is_torn = true;
+            break;
+        }
+        if (record.sequence > after_sequence) {
+            handler(record);
+        }
+        result.last_sequence = record.sequence;
+        offset = next_offset;
+    }
+    result.valid_size = offset;
+    return result;
+}